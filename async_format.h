@@ -0,0 +1,344 @@
+// Awaitable cppbits::format output to non-blocking file descriptors.
+//
+// Requires C++20 coroutines and Linux (epoll).
+//
+// Writing cppbits::format output to a socket with an ostream blocks the thread
+// whenever the socket buffer is full, which is bad news on an event loop
+// thread. async_format_to renders into a pooled buffer and writes as much as
+// the descriptor will take right away. Only if the write would block does the
+// coroutine suspend; the event loop resumes it once everything has been
+// written. In the common case where the kernel accepts the whole thing, the
+// coroutine never suspends at all.
+//
+// USAGE:
+//
+//    The descriptor must be in non-blocking mode (O_NONBLOCK).
+//
+//       cppbits::event_loop loop;
+//       cppbits::fd_sink out(loop, client_fd);
+//
+//       my_task handle(cppbits::fd_sink& out)
+//       {
+//          co_await cppbits::async_format_to(out, "HTTP/1.1 {0} {1}\r\n", 200, "OK");
+//          ...
+//       }
+//
+//       loop.run();
+//
+//    co_await yields the number of bytes written, and throws std::system_error
+//    if the write fails. Any coroutine type works; async_format_to doesn't
+//    care what it is awaited from.
+//
+//    Only have one write outstanding per fd_sink at a time, otherwise output
+//    from different writes can interleave. Call event_loop::forget(fd) before
+//    closing a descriptor that has been waited on.
+//
+//    Destroying a coroutine while it is suspended in async_format_to cancels
+//    the wait; whatever hasn't been written yet is dropped.
+//
+//    If fd is a socket or pipe whose reader might go away, ignore SIGPIPE (or
+//    you'll get killed instead of getting EPIPE).
+//
+// ===============================================================================
+// This file is released into the public domain. See LICENCE for more information.
+// ===============================================================================
+
+#pragma once
+
+#include <cerrno>
+#include <coroutine>
+#include <cstddef>
+#include <functional>
+#include <streambuf>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include "format.h"
+
+namespace cppbits {
+
+// A minimal epoll loop that calls back when a descriptor becomes writable.
+class event_loop
+{
+public:
+	event_loop() :
+		m_epoll(::epoll_create1(EPOLL_CLOEXEC))
+	{
+		if (m_epoll < 0)
+			throw std::system_error(errno, std::generic_category(), "epoll_create1");
+	}
+
+	~event_loop()
+	{
+		::close(m_epoll);
+	}
+
+	event_loop(const event_loop&) = delete;
+	event_loop& operator=(const event_loop&) = delete;
+
+	// Calls ready (once) the next time fd is writable, or has an error.
+	void wait_writable(int fd, std::function<void()> ready)
+	{
+		epoll_event ev = {};
+		ev.events = EPOLLOUT | EPOLLONESHOT;
+		ev.data.fd = fd;
+
+		// EPOLLONESHOT leaves the descriptor registered but disarmed after it
+		// fires, so after the first time we re-arm it with MOD.
+		const bool known = m_known.find(fd) != m_known.end();
+		if (::epoll_ctl(m_epoll, known ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &ev) < 0)
+			throw std::system_error(errno, std::generic_category(), "epoll_ctl");
+
+		m_known.insert(fd);
+		m_waiting[fd] = std::move(ready);
+	}
+
+	// Drops the callback registered for fd, if any, without running it. fd
+	// stays registered, so waiting on it again is cheap.
+	void cancel(int fd)
+	{
+		m_waiting.erase(fd);
+	}
+
+	// Stops watching fd. Call this before closing it.
+	void forget(int fd)
+	{
+		if (m_known.erase(fd))
+			::epoll_ctl(m_epoll, EPOLL_CTL_DEL, fd, nullptr);
+		m_waiting.erase(fd);
+	}
+
+	bool has_waiters() const
+	{
+		return !m_waiting.empty();
+	}
+
+	// Waits up to timeout_ms (-1 for forever) and dispatches whatever is
+	// ready. Returns the number of callbacks run.
+	size_t run_once(int timeout_ms = -1)
+	{
+		epoll_event events[64];
+		const int n = ::epoll_wait(m_epoll, events, 64, timeout_ms);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				return 0;
+			throw std::system_error(errno, std::generic_category(), "epoll_wait");
+		}
+
+		size_t dispatched = 0;
+		for (int i = 0; i < n; ++i)
+		{
+			auto itr = m_waiting.find(events[i].data.fd);
+			if (itr == m_waiting.end())
+				continue;
+
+			// The callback may well call wait_writable again for the same fd.
+			std::function<void()> ready = std::move(itr->second);
+			m_waiting.erase(itr);
+			ready();
+			++dispatched;
+		}
+		return dispatched;
+	}
+
+	// Runs until nothing is waiting any more.
+	void run()
+	{
+		while (has_waiters())
+			run_once();
+	}
+
+private:
+	int m_epoll;
+	std::unordered_set<int> m_known;
+	std::unordered_map<int, std::function<void()>> m_waiting;
+};
+
+// A non-blocking descriptor plus the loop that should wait on it.
+class fd_sink
+{
+public:
+	fd_sink(event_loop& loop, int fd) : m_loop(loop), m_fd(fd) {}
+
+	event_loop& loop() const { return m_loop; }
+	int fd() const { return m_fd; }
+
+private:
+	event_loop& m_loop;
+	int m_fd;
+};
+
+namespace detail {
+
+// A per-thread free list of render buffers, so that steady-state formatting
+// doesn't allocate.
+class format_buffer_pool
+{
+public:
+	static std::string acquire()
+	{
+		std::vector<std::string>& pool = buffers();
+		if (pool.empty())
+			return std::string();
+		std::string buffer = std::move(pool.back());
+		pool.pop_back();
+		return buffer;
+	}
+
+	static void release(std::string&& buffer)
+	{
+		std::vector<std::string>& pool = buffers();
+		// Don't let one huge response pin memory forever.
+		if (pool.size() >= kMaxPooled || buffer.capacity() > kMaxPooledCapacity)
+			return;
+		buffer.clear();
+		pool.push_back(std::move(buffer));
+	}
+
+private:
+	static const size_t kMaxPooled = 16;
+	static const size_t kMaxPooledCapacity = 64 * 1024;
+
+	static std::vector<std::string>& buffers()
+	{
+		static thread_local std::vector<std::string> pool;
+		return pool;
+	}
+};
+
+// Appends everything written to it onto a std::string.
+class string_append_streambuf : public std::streambuf
+{
+public:
+	explicit string_append_streambuf(std::string& str) : m_str(str) {}
+
+protected:
+	virtual int_type overflow(int_type ch)
+	{
+		if (!traits_type::eq_int_type(ch, traits_type::eof()))
+			m_str.push_back(traits_type::to_char_type(ch));
+		return traits_type::not_eof(ch);
+	}
+
+	virtual std::streamsize xsputn(const char* s, std::streamsize count)
+	{
+		m_str.append(s, static_cast<size_t>(count));
+		return count;
+	}
+
+private:
+	std::string& m_str;
+};
+
+class async_write_op
+{
+public:
+	async_write_op(fd_sink& sink, std::string&& buffer) :
+		m_sink(sink),
+		m_buffer(std::move(buffer)),
+		m_written(0),
+		m_error(0),
+		m_armed(false)
+	{}
+
+	~async_write_op()
+	{
+		// The awaiting coroutine was destroyed while suspended on us; don't
+		// leave the loop holding a callback that points at this object.
+		if (m_armed)
+			m_sink.loop().cancel(m_sink.fd());
+		format_buffer_pool::release(std::move(m_buffer));
+	}
+
+	async_write_op(const async_write_op&) = delete;
+	async_write_op& operator=(const async_write_op&) = delete;
+
+	bool await_ready()
+	{
+		return write_some();
+	}
+
+	void await_suspend(std::coroutine_handle<> coroutine)
+	{
+		m_coroutine = coroutine;
+		arm();
+	}
+
+	size_t await_resume()
+	{
+		if (m_error)
+			throw std::system_error(m_error, std::generic_category(), "async_format_to");
+		return m_written;
+	}
+
+private:
+	// Writes until done or the descriptor is full. Returns true if there's
+	// nothing more to do (finished, or failed).
+	bool write_some()
+	{
+		while (m_written < m_buffer.size())
+		{
+			const ssize_t n = ::write(m_sink.fd(), m_buffer.data() + m_written, m_buffer.size() - m_written);
+			if (n >= 0)
+			{
+				m_written += static_cast<size_t>(n);
+			}
+			else if (errno == EAGAIN || errno == EWOULDBLOCK)
+			{
+				return false;
+			}
+			else if (errno != EINTR)
+			{
+				m_error = errno;
+				return true;
+			}
+		}
+		return true;
+	}
+
+	void arm()
+	{
+		m_sink.loop().wait_writable(m_sink.fd(), [this] {
+			// The loop drops the callback before running it.
+			m_armed = false;
+			if (write_some())
+				m_coroutine.resume();
+			else
+				arm();
+		});
+		m_armed = true;
+	}
+
+	fd_sink& m_sink;
+	std::string m_buffer;
+	size_t m_written;
+	int m_error;
+	bool m_armed; // a callback for us is registered with the loop
+	std::coroutine_handle<> m_coroutine;
+};
+
+} // namespace detail
+
+// Renders the format string now, and returns an awaitable that writes it to
+// sink, suspending only if the descriptor can't take it all immediately.
+template<class ... T>
+detail::async_write_op async_format_to(fd_sink& sink, const std::string& str, T... args)
+{
+	std::string buffer = detail::format_buffer_pool::acquire();
+	{
+		detail::string_append_streambuf buf(buffer);
+		std::ostream o(&buf);
+		o << format(str, std::forward<T>(args)...);
+	}
+	return detail::async_write_op(sink, std::move(buffer));
+}
+
+} // namespace cppbits
@@ -0,0 +1,39 @@
+// Small bit-manipulation helpers shared by the other headers.
+//
+// ===============================================================================
+// This file is released into the public domain. See LICENCE for more information.
+// ===============================================================================
+
+#pragma once
+
+#include <cstdint>
+
+#if defined(_MSC_VER)
+   #include <intrin.h>
+#endif
+
+namespace cppbits {
+
+namespace detail {
+
+// Index of the lowest set bit. x must not be zero.
+inline unsigned lowest_set_bit(uint64_t x)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+   unsigned long index;
+   _BitScanForward64(&index, x);
+   return index;
+#elif defined(_MSC_VER)
+   unsigned long index;
+   if (_BitScanForward(&index, static_cast<unsigned long>(x)))
+      return index;
+   _BitScanForward(&index, static_cast<unsigned long>(x >> 32));
+   return index + 32;
+#else
+   return static_cast<unsigned>(__builtin_ctzll(x));
+#endif
+}
+
+} // namespace detail
+
+} // namespace cppbits
@@ -0,0 +1,147 @@
+// Reference-counted flags, for when several owners share one interest mask.
+//
+// If two components both want kInterestWrite set on the same epoll
+// registration, a plain flags value can't tell when it's safe to clear it:
+// the first component to finish drops the bit for both. counted_flags keeps a
+// counter per bit instead, and a bit is only part of the effective mask while
+// its counter is non-zero.
+//
+// The effective mask is cached, and only updated for the bits whose counters
+// actually go to or from zero, so reading it is just a load.
+//
+// To use:
+//
+//    E must be an enum for which cppbits::is_enum_flags is specialized (see
+//    enum_flags.h).
+//
+//       cppbits::counted_flags<Interest> interest;
+//
+//       interest.acquire(kInterestRead | kInterestWrite); // component A
+//       interest.acquire(kInterestWrite);                 // component B
+//       interest.release(kInterestRead | kInterestWrite); // A is done
+//
+//       interest.value() == kInterestWrite;               // still wanted by B
+//
+//    acquire() and release() return the bits that changed in the effective
+//    mask, which is handy for deciding whether you need to tell the kernel:
+//
+//       if (interest.release(kInterestWrite) != kInterestNone)
+//          update_epoll(fd, interest.value());
+//
+//    Releasing a bit more times than it was acquired is a bug; it asserts in
+//    debug builds and is ignored otherwise. So is acquiring a bit more times
+//    than Counter can count: that asserts in debug builds, and otherwise the
+//    count sticks at its maximum, so the bit stays set rather than wrapping
+//    to zero.
+//
+// counted_flags is not thread-safe.
+//
+// ===============================================================================
+// This file is released into the public domain. See LICENCE for more information.
+// ===============================================================================
+
+#pragma once
+
+#include <cassert>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+
+#include "bits.h"
+#include "enum_flags.h"
+
+namespace cppbits {
+
+template<class E, class Counter = uint32_t>
+class counted_flags
+{
+   static_assert(std::is_enum<E>::value && is_enum_flags<E>::value,
+      "counted_flags requires an enum type with is_enum_flags specialized");
+   static_assert(std::is_unsigned<Counter>::value, "Counter must be an unsigned integer type");
+
+   typedef typename std::underlying_type<E>::type underlying_type;
+   typedef typename std::make_unsigned<underlying_type>::type bits_type;
+
+public:
+   static const size_t bit_count = sizeof(E) * CHAR_BIT;
+
+   counted_flags() : m_value(0)
+   {
+      for (size_t i = 0; i < bit_count; ++i)
+         m_counts[i] = 0;
+   }
+
+   // Adds a reference to each bit in flags. Returns the bits that were newly
+   // added to the effective mask.
+   E acquire(E flags)
+   {
+      bits_type changed = 0;
+      for (uint64_t bits = to_bits(flags); bits != 0; bits &= bits - 1)
+      {
+         const unsigned i = detail::lowest_set_bit(bits);
+         assert(m_counts[i] != std::numeric_limits<Counter>::max() && "counted_flags: Counter overflow");
+         if (m_counts[i] == std::numeric_limits<Counter>::max())
+            continue;
+         if (m_counts[i]++ == 0)
+            changed |= static_cast<bits_type>(bits_type(1) << i);
+      }
+      m_value |= changed;
+      return static_cast<E>(changed);
+   }
+
+   // Drops a reference to each bit in flags. Returns the bits that were
+   // removed from the effective mask.
+   E release(E flags)
+   {
+      bits_type changed = 0;
+      for (uint64_t bits = to_bits(flags); bits != 0; bits &= bits - 1)
+      {
+         const unsigned i = detail::lowest_set_bit(bits);
+         assert(m_counts[i] != 0 && "counted_flags: bit released more times than acquired");
+         if (m_counts[i] != 0 && --m_counts[i] == 0)
+            changed |= static_cast<bits_type>(bits_type(1) << i);
+      }
+      m_value &= static_cast<bits_type>(~changed);
+      return static_cast<E>(changed);
+   }
+
+   // The effective mask: every bit with a non-zero count.
+   E value() const
+   {
+      return static_cast<E>(m_value);
+   }
+
+   // True if every bit in flags is currently held by someone.
+   bool test(E flags) const
+   {
+      return (m_value & to_bits(flags)) == to_bits(flags);
+   }
+
+   // The number of outstanding references on a single bit.
+   Counter count(E flag) const
+   {
+      const uint64_t bits = to_bits(flag);
+      assert(bits != 0 && (bits & (bits - 1)) == 0 && "counted_flags::count takes a single bit");
+      return bits ? m_counts[detail::lowest_set_bit(bits)] : 0;
+   }
+
+   void clear()
+   {
+      for (size_t i = 0; i < bit_count; ++i)
+         m_counts[i] = 0;
+      m_value = 0;
+   }
+
+private:
+   static uint64_t to_bits(E flags)
+   {
+      return static_cast<bits_type>(static_cast<underlying_type>(flags));
+   }
+
+   bits_type m_value;
+   Counter m_counts[bit_count];
+};
+
+} // namespace cppbits
@@ -0,0 +1,296 @@
+// Runtime CPU feature detection and one-time kernel dispatch.
+//
+// Code that wants to use SIMD still has to run on machines that don't have it,
+// so each vectorized kernel gets built in several variants and the best one
+// the CPU supports gets picked the first time it is called.
+//
+// Feature detection uses CPUID (and XGETBV, to make sure the OS actually saves
+// the AVX/AVX-512 register state). On non-x86 targets everything reports as
+// unsupported and the scalar variants get used.
+//
+// Features are grouped into levels, roughly by CPU generation:
+//
+//    kCpuLevelScalar -> no SIMD requirements
+//    kCpuLevelSSE42  -> SSE4.2, POPCNT (Nehalem and later)
+//    kCpuLevelAVX2   -> AVX2, BMI1, BMI2 (Haswell and later)
+//    kCpuLevelAVX512 -> AVX-512 F, BW, VL (Skylake-SP and later)
+//
+// The environment variable CPPBITS_CPU_LEVEL caps the level that gets used,
+// which lets you exercise every code path on one machine:
+//
+//    CPPBITS_CPU_LEVEL=scalar ./my_tests
+//    CPPBITS_CPU_LEVEL=sse4.2 ./my_tests
+//    CPPBITS_CPU_LEVEL=avx2   ./my_tests
+//
+// It can only lower the level, never raise it above what the CPU supports.
+// The variable is read once, the first time current_cpu_level() is called.
+//
+// USAGE:
+//
+//    Compile each variant with the matching CPPBITS_TARGET_* attribute so it
+//    can use the instructions without building the whole program for them:
+//
+//       static size_t count_scalar(const uint64_t* p, size_t n) { ... }
+//       CPPBITS_TARGET_AVX2 static size_t count_avx2(const uint64_t* p, size_t n) { ... }
+//
+//    Then resolve the kernel once and call through the pointer:
+//
+//       typedef size_t (*count_fn)(const uint64_t*, size_t);
+//
+//       size_t count(const uint64_t* p, size_t n)
+//       {
+//          static const count_fn fn = cppbits::select_kernel(
+//             cppbits::kernel_variants<count_fn>(count_scalar, nullptr, count_avx2));
+//          return fn(p, n);
+//       }
+//
+//    Any variant other than scalar may be nullptr; select_kernel falls back to
+//    the next lower level that has one. To test a specific variant directly,
+//    pass the level you want as the second argument to select_kernel.
+//
+// ===============================================================================
+// This file is released into the public domain. See LICENCE for more information.
+// ===============================================================================
+
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <type_traits>
+
+#include "enum_flags.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+   #define CPPBITS_CPU_X86
+   #if defined(_MSC_VER)
+      #include <intrin.h>
+   #else
+      #include <cpuid.h>
+   #endif
+#endif
+
+// Lets a single function use instructions beyond what the rest of the
+// translation unit was compiled for. MSVC doesn't need (or have) this; it
+// will happily emit any intrinsic you ask for.
+#if defined(CPPBITS_CPU_X86) && (defined(__GNUC__) || defined(__clang__))
+   #define CPPBITS_TARGET_SSE42 __attribute__((target("sse4.2,popcnt")))
+   #define CPPBITS_TARGET_AVX2 __attribute__((target("avx2,bmi,bmi2,popcnt")))
+   #define CPPBITS_TARGET_AVX512 __attribute__((target("avx512f,avx512bw,avx512vl,avx2,bmi,bmi2,popcnt")))
+#else
+   #define CPPBITS_TARGET_SSE42
+   #define CPPBITS_TARGET_AVX2
+   #define CPPBITS_TARGET_AVX512
+#endif
+
+namespace cppbits {
+
+enum cpu_feature : uint32_t
+{
+   kCpuFeatureNone = 0,
+   kCpuFeatureSSE42 = 1 << 0,
+   kCpuFeaturePOPCNT = 1 << 1,
+   kCpuFeatureAVX = 1 << 2,
+   kCpuFeatureAVX2 = 1 << 3,
+   kCpuFeatureBMI1 = 1 << 4,
+   kCpuFeatureBMI2 = 1 << 5,
+   kCpuFeatureAVX512F = 1 << 6,
+   kCpuFeatureAVX512BW = 1 << 7,
+   kCpuFeatureAVX512VL = 1 << 8
+};
+
+template<>
+struct is_enum_flags<cpu_feature> : std::true_type{};
+
+enum cpu_level
+{
+   kCpuLevelScalar = 0,
+   kCpuLevelSSE42,
+   kCpuLevelAVX2,
+   kCpuLevelAVX512
+};
+
+namespace detail {
+
+#if defined(CPPBITS_CPU_X86)
+
+inline void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t regs[4])
+{
+#if defined(_MSC_VER)
+   int r[4];
+   __cpuidex(r, static_cast<int>(leaf), static_cast<int>(subleaf));
+   for (int i = 0; i < 4; ++i)
+      regs[i] = static_cast<uint32_t>(r[i]);
+#else
+   __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+inline uint64_t xgetbv0()
+{
+#if defined(_MSC_VER)
+   return _xgetbv(0);
+#else
+   uint32_t eax, edx;
+   __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+   return (static_cast<uint64_t>(edx) << 32) | eax;
+#endif
+}
+
+inline cpu_feature detect_cpu_features()
+{
+   cpu_feature features = kCpuFeatureNone;
+   uint32_t regs[4]; // eax, ebx, ecx, edx
+
+   cpuid(0, 0, regs);
+   const uint32_t max_leaf = regs[0];
+   if (max_leaf < 1)
+      return features;
+
+   cpuid(1, 0, regs);
+   const uint32_t ecx1 = regs[2];
+   if (ecx1 & (1u << 20))
+      features |= kCpuFeatureSSE42;
+   if (ecx1 & (1u << 23))
+      features |= kCpuFeaturePOPCNT;
+
+   // AVX needs both the CPU and the OS (OSXSAVE, and XMM/YMM state enabled in XCR0).
+   const bool osxsave = (ecx1 & (1u << 27)) != 0;
+   const uint64_t xcr0 = osxsave ? xgetbv0() : 0;
+   const bool os_avx = (xcr0 & 0x6) == 0x6;
+   const bool os_avx512 = (xcr0 & 0xE6) == 0xE6;
+
+   if (os_avx && (ecx1 & (1u << 28)))
+      features |= kCpuFeatureAVX;
+
+   if (max_leaf >= 7)
+   {
+      cpuid(7, 0, regs);
+      const uint32_t ebx7 = regs[1];
+      if (ebx7 & (1u << 3))
+         features |= kCpuFeatureBMI1;
+      if (ebx7 & (1u << 8))
+         features |= kCpuFeatureBMI2;
+      if (os_avx && (ebx7 & (1u << 5)))
+         features |= kCpuFeatureAVX2;
+      if (os_avx512)
+      {
+         if (ebx7 & (1u << 16))
+            features |= kCpuFeatureAVX512F;
+         if (ebx7 & (1u << 30))
+            features |= kCpuFeatureAVX512BW;
+         if (ebx7 & (1u << 31))
+            features |= kCpuFeatureAVX512VL;
+      }
+   }
+
+   return features;
+}
+
+#else
+
+inline cpu_feature detect_cpu_features()
+{
+   return kCpuFeatureNone;
+}
+
+#endif
+
+inline bool has_all(cpu_feature features, cpu_feature wanted)
+{
+   return (features & wanted) == wanted;
+}
+
+inline cpu_level level_from_features(cpu_feature features)
+{
+   if (has_all(features, kCpuFeatureAVX512F | kCpuFeatureAVX512BW | kCpuFeatureAVX512VL |
+         kCpuFeatureAVX2 | kCpuFeatureBMI1 | kCpuFeatureBMI2 | kCpuFeaturePOPCNT))
+      return kCpuLevelAVX512;
+   if (has_all(features, kCpuFeatureAVX2 | kCpuFeatureBMI1 | kCpuFeatureBMI2 | kCpuFeaturePOPCNT))
+      return kCpuLevelAVX2;
+   if (has_all(features, kCpuFeatureSSE42 | kCpuFeaturePOPCNT))
+      return kCpuLevelSSE42;
+   return kCpuLevelScalar;
+}
+
+// Parses CPPBITS_CPU_LEVEL. Unknown values are ignored (returns the highest level).
+inline cpu_level level_from_environment()
+{
+#if defined(_MSC_VER)
+   #pragma warning(push)
+   #pragma warning(disable: 4996) // getenv is fine here; we only read it once.
+#endif
+   const char* value = std::getenv("CPPBITS_CPU_LEVEL");
+#if defined(_MSC_VER)
+   #pragma warning(pop)
+#endif
+
+   if (!value)
+      return kCpuLevelAVX512;
+   if (std::strcmp(value, "scalar") == 0)
+      return kCpuLevelScalar;
+   if (std::strcmp(value, "sse4.2") == 0 || std::strcmp(value, "sse42") == 0)
+      return kCpuLevelSSE42;
+   if (std::strcmp(value, "avx2") == 0)
+      return kCpuLevelAVX2;
+   return kCpuLevelAVX512;
+}
+
+} // namespace detail
+
+// The features this CPU (and OS) supports. Not affected by CPPBITS_CPU_LEVEL.
+inline cpu_feature cpu_features()
+{
+   static const cpu_feature features = detail::detect_cpu_features();
+   return features;
+}
+
+// The highest level that both the CPU supports and CPPBITS_CPU_LEVEL allows.
+inline cpu_level current_cpu_level()
+{
+   static const cpu_level level = [] {
+      const cpu_level detected = detail::level_from_features(cpu_features());
+      const cpu_level allowed = detail::level_from_environment();
+      return detected < allowed ? detected : allowed;
+   }();
+   return level;
+}
+
+// One function pointer per level. Only the scalar variant is required.
+template<class Fn>
+struct kernel_variants
+{
+   static_assert(std::is_pointer<Fn>::value, "kernel_variants needs a function pointer type");
+
+   kernel_variants(Fn scalar, Fn sse42 = nullptr, Fn avx2 = nullptr, Fn avx512 = nullptr)
+   {
+      variants[kCpuLevelScalar] = scalar;
+      variants[kCpuLevelSSE42] = sse42;
+      variants[kCpuLevelAVX2] = avx2;
+      variants[kCpuLevelAVX512] = avx512;
+   }
+
+   Fn variants[kCpuLevelAVX512 + 1];
+};
+
+// Picks the best variant at or below the given level. Callers should store
+// the result (e.g. in a function-local static) rather than calling this on
+// every invocation of the kernel.
+template<class Fn>
+Fn select_kernel(const kernel_variants<Fn>& kernels, cpu_level level)
+{
+   for (int i = level; i > kCpuLevelScalar; --i)
+   {
+      if (kernels.variants[i])
+         return kernels.variants[i];
+   }
+   return kernels.variants[kCpuLevelScalar];
+}
+
+template<class Fn>
+Fn select_kernel(const kernel_variants<Fn>& kernels)
+{
+   return select_kernel(kernels, current_cpu_level());
+}
+
+} // namespace cppbits
@@ -42,6 +42,8 @@
 // This file is released into the public domain. See LICENCE for more information.
 // ===============================================================================
 
+#pragma once
+
 #include <type_traits>
 
 // Try not to pollute the global namespace with my own type traits.
@@ -60,7 +62,7 @@ inline typename std::enable_if<
       std::is_enum<T>::value && cppbits::is_enum_flags<T>::value, T>::type
    operator~(const T a)
 {
-   return static_cast<T>(~static_cast<std::underlying_type<T>::type>(a));
+   return static_cast<T>(~static_cast<typename std::underlying_type<T>::type>(a));
 }
 
 template<class T>
@@ -68,7 +70,7 @@ inline typename std::enable_if<
       std::is_enum<T>::value && cppbits::is_enum_flags<T>::value, T>::type
    operator|(const T a, const T b)
 {
-   return static_cast<T>(static_cast<std::underlying_type<T>::type>(a) | static_cast<std::underlying_type<T>::type>(b));
+   return static_cast<T>(static_cast<typename std::underlying_type<T>::type>(a) | static_cast<typename std::underlying_type<T>::type>(b));
 }
 
 template<class T>
@@ -76,7 +78,7 @@ inline typename std::enable_if<
       std::is_enum<T>::value && cppbits::is_enum_flags<T>::value, T>::type
    operator&(const T a, const T b)
 {
-   return static_cast<T>(static_cast<std::underlying_type<T>::type>(a) & static_cast<std::underlying_type<T>::type>(b));
+   return static_cast<T>(static_cast<typename std::underlying_type<T>::type>(a) & static_cast<typename std::underlying_type<T>::type>(b));
 }
 
 template<class T>
@@ -84,7 +86,7 @@ inline typename std::enable_if<
       std::is_enum<T>::value && cppbits::is_enum_flags<T>::value, T>::type
    operator^(const T a, const T b)
 {
-   return static_cast<T>(static_cast<std::underlying_type<T>::type>(a) ^ static_cast<std::underlying_type<T>::type>(b));
+   return static_cast<T>(static_cast<typename std::underlying_type<T>::type>(a) ^ static_cast<typename std::underlying_type<T>::type>(b));
 }
 
 template<class T, class Integer>
@@ -92,7 +94,7 @@ inline typename std::enable_if<
       std::is_enum<T>::value && cppbits::is_enum_flags<T>::value && std::is_integral<Integer>::value, T>::type
    operator>>(const T a, const Integer b)
 {
-   return static_cast<T>(static_cast<std::underlying_type<T>::type>(a) >> b);
+   return static_cast<T>(static_cast<typename std::underlying_type<T>::type>(a) >> b);
 }
 
 template<class T, class Integer>
@@ -100,7 +102,7 @@ inline typename std::enable_if<
       std::is_enum<T>::value && cppbits::is_enum_flags<T>::value && std::is_integral<Integer>::value, T>::type
    operator<<(const T a, const Integer b)
 {
-   return static_cast<T>(static_cast<std::underlying_type<T>::type>(a) << b);
+   return static_cast<T>(static_cast<typename std::underlying_type<T>::type>(a) << b);
 }
 
 template<class T>
@@ -108,7 +110,7 @@ inline typename std::enable_if<
       std::is_enum<T>::value && cppbits::is_enum_flags<T>::value, T&>::type
    operator|=(T& a, const T b)
 {
-   return ((a = static_cast<T>(static_cast<std::underlying_type<T>::type>(a) | static_cast<std::underlying_type<T>::type>(b))));
+   return ((a = static_cast<T>(static_cast<typename std::underlying_type<T>::type>(a) | static_cast<typename std::underlying_type<T>::type>(b))));
 }
 
 template<class T>
@@ -116,7 +118,7 @@ inline typename std::enable_if<
       std::is_enum<T>::value && cppbits::is_enum_flags<T>::value, T&>::type
    operator&=(T& a, const T b)
 {
-   return ((a = static_cast<T>(static_cast<std::underlying_type<T>::type>(a) & static_cast<std::underlying_type<T>::type>(b))));
+   return ((a = static_cast<T>(static_cast<typename std::underlying_type<T>::type>(a) & static_cast<typename std::underlying_type<T>::type>(b))));
 }
 
 template<class T>
@@ -124,7 +126,7 @@ inline typename std::enable_if<
       std::is_enum<T>::value && cppbits::is_enum_flags<T>::value, T&>::type
    operator^=(T& a, const T b)
 {
-   return ((a = static_cast<T>(static_cast<std::underlying_type<T>::type>(a) ^ static_cast<std::underlying_type<T>::type>(b))));
+   return ((a = static_cast<T>(static_cast<typename std::underlying_type<T>::type>(a) ^ static_cast<typename std::underlying_type<T>::type>(b))));
 }
 
 template<class T, class Integer>
@@ -132,7 +134,7 @@ inline typename std::enable_if<
       std::is_enum<T>::value && cppbits::is_enum_flags<T>::value && std::is_integral<Integer>::value, T&>::type
    operator>>=(T& a, const Integer b)
 {
-   return ((a = static_cast<T>(static_cast<std::underlying_type<T>::type>(a) >> b)));
+   return ((a = static_cast<T>(static_cast<typename std::underlying_type<T>::type>(a) >> b)));
 }
 
 template<class T, class Integer>
@@ -140,5 +142,5 @@ inline typename std::enable_if<
       std::is_enum<T>::value && cppbits::is_enum_flags<T>::value && std::is_integral<Integer>::value, T&>::type
    operator<<=(T& a, const Integer b)
 {
-   return ((a = static_cast<T>(static_cast<std::underlying_type<T>::type>(a) << b)));
+   return ((a = static_cast<T>(static_cast<typename std::underlying_type<T>::type>(a) << b)));
 }
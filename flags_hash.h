@@ -0,0 +1,124 @@
+// A hash function for enum_flags values (and other small integer keys).
+//
+// std::hash on an enum or integer is the identity function on most standard
+// libraries. That's fine for sequential IDs, but flag values are usually a
+// few bits set at powers of two, so with identity hashing they pile up in a
+// handful of buckets (with a power-of-two bucket count, every key whose low
+// bits are clear lands in bucket 0). flags_hash runs the value through a
+// 64-bit finalizer, so every input bit affects every output bit.
+//
+// It also hashes std::pair and std::tuple of such values, for maps keyed on
+// several flags at once.
+//
+// To use:
+//
+//    std::unordered_map<Permissions, Handler, cppbits::flags_hash> handlers;
+//    std::unordered_map<std::pair<Topic, Priority>, Queue*, cppbits::flags_hash> queues;
+//
+// std::equal_to already does the right thing for these keys, so there's no
+// special equality functor.
+//
+// See flat_flags_map.h for a hash table specialized for these keys.
+//
+// ===============================================================================
+// This file is released into the public domain. See LICENCE for more information.
+// ===============================================================================
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "enum_flags.h"
+
+namespace cppbits {
+
+// The MurmurHash3 64-bit finalizer: cheap, and a full avalanche.
+inline uint64_t mix64(uint64_t x)
+{
+   x ^= x >> 33;
+   x *= 0xff51afd7ed558ccdULL;
+   x ^= x >> 33;
+   x *= 0xc4ceb9fe1a85ec53ULL;
+   x ^= x >> 33;
+   return x;
+}
+
+namespace detail {
+
+inline uint64_t hash_combine(uint64_t seed, uint64_t value)
+{
+   return mix64(seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2)));
+}
+
+template<class T>
+inline typename std::enable_if<std::is_enum<T>::value, uint64_t>::type
+   flags_hash_bits(const T value)
+{
+   typedef typename std::underlying_type<T>::type underlying_type;
+   return static_cast<uint64_t>(static_cast<typename std::make_unsigned<underlying_type>::type>(
+      static_cast<underlying_type>(value)));
+}
+
+template<class T>
+inline typename std::enable_if<std::is_integral<T>::value, uint64_t>::type
+   flags_hash_bits(const T value)
+{
+   return static_cast<uint64_t>(value);
+}
+
+// Declared up front so that pairs of tuples (and so on) can find each other.
+template<class T>
+uint64_t flags_hash_value(const T& value);
+template<class A, class B>
+uint64_t flags_hash_value(const std::pair<A, B>& value);
+template<class ... T>
+uint64_t flags_hash_value(const std::tuple<T...>& value);
+
+template<class T>
+inline uint64_t flags_hash_value(const T& value)
+{
+   return mix64(flags_hash_bits(value));
+}
+
+template<class A, class B>
+inline uint64_t flags_hash_value(const std::pair<A, B>& value)
+{
+   return hash_combine(flags_hash_value(value.first), flags_hash_value(value.second));
+}
+
+template<size_t I, class Tuple>
+inline typename std::enable_if<(I == std::tuple_size<Tuple>::value), uint64_t>::type
+   flags_hash_tuple(uint64_t seed, const Tuple&)
+{
+   return seed;
+}
+
+template<size_t I, class Tuple>
+inline typename std::enable_if<(I < std::tuple_size<Tuple>::value), uint64_t>::type
+   flags_hash_tuple(uint64_t seed, const Tuple& value)
+{
+   return flags_hash_tuple<I + 1>(hash_combine(seed, flags_hash_value(std::get<I>(value))), value);
+}
+
+template<class ... T>
+inline uint64_t flags_hash_value(const std::tuple<T...>& value)
+{
+   return flags_hash_tuple<0>(0, value);
+}
+
+} // namespace detail
+
+struct flags_hash
+{
+   template<class T>
+   size_t operator()(const T& value) const
+   {
+      return static_cast<size_t>(detail::flags_hash_value(value));
+   }
+};
+
+} // namespace cppbits
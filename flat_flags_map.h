@@ -0,0 +1,498 @@
+// An open-addressing hash map for enum_flags (and other small integer) keys.
+//
+// std::unordered_map allocates a node per element and chases a pointer per
+// lookup. flat_flags_map keeps everything in flat arrays instead, and uses
+// the "control byte" scheme from SwissTable: every slot has one byte holding
+// either a marker (empty/deleted) or 7 bits of the key's hash. Lookups scan
+// 16 control bytes at a time (with SSE2 where available), so most misses and
+// hits only ever touch one group of control bytes and one slot.
+//
+// Keys must be enums or integers (anything flags_hash takes that fits in a
+// register); they are hashed with flags_hash, so flag-shaped keys spread out
+// properly.
+//
+// To use:
+//
+//    cppbits::flat_flags_map<Permissions, Handler*> handlers;
+//
+//    handlers[kPermissionRead | kPermissionWrite] = &rw_handler;
+//
+//    auto itr = handlers.find(requested);
+//    if (itr != handlers.end())
+//       itr->second->run();
+//
+//    handlers.erase(kPermissionRead);
+//
+// The interface is a subset of std::unordered_map. Unlike std::unordered_map,
+// any insert may move every element, invalidating all iterators and
+// references.
+//
+// ===============================================================================
+// This file is released into the public domain. See LICENCE for more information.
+// ===============================================================================
+
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+   #define CPPBITS_FLAT_MAP_SSE2
+   #include <emmintrin.h>
+#endif
+
+#include "bits.h"
+#include "flags_hash.h"
+
+namespace cppbits {
+
+namespace detail {
+
+enum : int8_t
+{
+   kCtrlEmpty = -128,  // 0b10000000
+   kCtrlDeleted = -2,  // 0b11111110
+   // Full slots hold 7 bits of hash, 0b0xxxxxxx.
+};
+
+// 16 control bytes, and bitmasks of which of them match.
+class ctrl_group
+{
+public:
+   static const size_t width = 16;
+
+   explicit ctrl_group(const int8_t* ctrl) : m_ctrl(ctrl) {}
+
+#if defined(CPPBITS_FLAT_MAP_SSE2)
+   uint32_t match(int8_t h2) const
+   {
+      const __m128i ctrl = load();
+      return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), ctrl)));
+   }
+
+   uint32_t match_empty() const
+   {
+      return match(kCtrlEmpty);
+   }
+
+   uint32_t match_empty_or_deleted() const
+   {
+      // Both markers are < -1; full slots are >= 0.
+      const __m128i ctrl = load();
+      return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(-1), ctrl)));
+   }
+
+private:
+   __m128i load() const
+   {
+      return _mm_load_si128(reinterpret_cast<const __m128i*>(m_ctrl));
+   }
+#else
+   uint32_t match(int8_t h2) const
+   {
+      uint32_t mask = 0;
+      for (size_t i = 0; i < width; ++i)
+         mask |= static_cast<uint32_t>(m_ctrl[i] == h2) << i;
+      return mask;
+   }
+
+   uint32_t match_empty() const
+   {
+      return match(kCtrlEmpty);
+   }
+
+   uint32_t match_empty_or_deleted() const
+   {
+      uint32_t mask = 0;
+      for (size_t i = 0; i < width; ++i)
+         mask |= static_cast<uint32_t>(m_ctrl[i] < -1) << i;
+      return mask;
+   }
+
+private:
+#endif
+
+   const int8_t* m_ctrl;
+};
+
+} // namespace detail
+
+template<class K, class V, class Hash = flags_hash>
+class flat_flags_map
+{
+   static_assert(std::is_enum<K>::value || std::is_integral<K>::value,
+      "flat_flags_map keys must be enums or integers");
+
+   typedef detail::ctrl_group group;
+
+public:
+   typedef K key_type;
+   typedef V mapped_type;
+   typedef std::pair<const K, V> value_type;
+   typedef size_t size_type;
+
+   template<class Map, class Value>
+   class iterator_base
+   {
+   public:
+      typedef std::forward_iterator_tag iterator_category;
+      typedef typename flat_flags_map::value_type value_type;
+      typedef std::ptrdiff_t difference_type;
+      typedef Value* pointer;
+      typedef Value& reference;
+
+      iterator_base() : m_map(nullptr), m_index(0) {}
+
+      // iterator -> const_iterator
+      template<class OtherMap, class OtherValue>
+      iterator_base(const iterator_base<OtherMap, OtherValue>& other) :
+         m_map(other.m_map), m_index(other.m_index)
+      {}
+
+      reference operator*() const { return *m_map->slot(m_index); }
+      pointer operator->() const { return m_map->slot(m_index); }
+
+      iterator_base& operator++()
+      {
+         m_index = m_map->next_full(m_index + 1);
+         return *this;
+      }
+
+      iterator_base operator++(int)
+      {
+         iterator_base old = *this;
+         ++*this;
+         return old;
+      }
+
+      bool operator==(const iterator_base& other) const { return m_index == other.m_index; }
+      bool operator!=(const iterator_base& other) const { return m_index != other.m_index; }
+
+   private:
+      template<class, class> friend class iterator_base;
+      friend class flat_flags_map;
+
+      iterator_base(Map* map, size_t index) : m_map(map), m_index(index) {}
+
+      Map* m_map;
+      size_t m_index;
+   };
+
+   typedef iterator_base<flat_flags_map, value_type> iterator;
+   typedef iterator_base<const flat_flags_map, const value_type> const_iterator;
+
+   flat_flags_map() :
+      m_ctrl(nullptr), m_slots(nullptr), m_capacity(0), m_size(0), m_growth_left(0)
+   {}
+
+   flat_flags_map(const flat_flags_map& other) :
+      m_ctrl(nullptr), m_slots(nullptr), m_capacity(0), m_size(0), m_growth_left(0)
+   {
+      reserve(other.size());
+      for (const value_type& item : other)
+         insert(item);
+   }
+
+   flat_flags_map(flat_flags_map&& other) :
+      m_ctrl(other.m_ctrl), m_slots(other.m_slots), m_capacity(other.m_capacity),
+      m_size(other.m_size), m_growth_left(other.m_growth_left)
+   {
+      other.m_ctrl = nullptr;
+      other.m_slots = nullptr;
+      other.m_capacity = other.m_size = other.m_growth_left = 0;
+   }
+
+   flat_flags_map& operator=(flat_flags_map other)
+   {
+      swap(other);
+      return *this;
+   }
+
+   ~flat_flags_map()
+   {
+      destroy();
+   }
+
+   void swap(flat_flags_map& other)
+   {
+      std::swap(m_ctrl, other.m_ctrl);
+      std::swap(m_slots, other.m_slots);
+      std::swap(m_capacity, other.m_capacity);
+      std::swap(m_size, other.m_size);
+      std::swap(m_growth_left, other.m_growth_left);
+   }
+
+   iterator begin() { return iterator(this, next_full(0)); }
+   iterator end() { return iterator(this, m_capacity); }
+   const_iterator begin() const { return const_iterator(this, next_full(0)); }
+   const_iterator end() const { return const_iterator(this, m_capacity); }
+
+   size_type size() const { return m_size; }
+   bool empty() const { return m_size == 0; }
+   size_type capacity() const { return m_capacity; }
+
+   iterator find(const K key)
+   {
+      return iterator(this, find_index(key));
+   }
+
+   const_iterator find(const K key) const
+   {
+      return const_iterator(this, find_index(key));
+   }
+
+   size_type count(const K key) const
+   {
+      return find_index(key) != m_capacity ? 1 : 0;
+   }
+
+   template<class ... Args>
+   std::pair<iterator, bool> try_emplace(const K key, Args&&... args)
+   {
+      const uint64_t hash = hash_of(key);
+      size_t index = find_index(key, hash);
+      if (index != m_capacity)
+         return std::make_pair(iterator(this, index), false);
+
+      if (m_growth_left == 0)
+         rehash_for_insert();
+
+      index = find_insert_index(hash);
+      ::new (static_cast<void*>(slot(index))) value_type(std::piecewise_construct,
+         std::forward_as_tuple(key), std::forward_as_tuple(std::forward<Args>(args)...));
+
+      if (m_ctrl[index] == detail::kCtrlEmpty)
+         --m_growth_left;
+      m_ctrl[index] = h2(hash);
+      ++m_size;
+      return std::make_pair(iterator(this, index), true);
+   }
+
+   std::pair<iterator, bool> insert(const value_type& value)
+   {
+      return try_emplace(value.first, value.second);
+   }
+
+   V& operator[](const K key)
+   {
+      return try_emplace(key).first->second;
+   }
+
+   size_type erase(const K key)
+   {
+      const size_t index = find_index(key);
+      if (index == m_capacity)
+         return 0;
+      erase_index(index);
+      return 1;
+   }
+
+   void erase(const_iterator pos)
+   {
+      erase_index(pos.m_index);
+   }
+
+   void clear()
+   {
+      for (size_t i = 0; i < m_capacity; ++i)
+      {
+         if (m_ctrl[i] >= 0)
+            slot(i)->~value_type();
+      }
+      if (m_capacity)
+         std::memset(m_ctrl, detail::kCtrlEmpty, m_capacity);
+      m_size = 0;
+      m_growth_left = max_load(m_capacity);
+   }
+
+   // Makes room for at least n elements without rehashing.
+   void reserve(size_type n)
+   {
+      if (n <= m_size + m_growth_left)
+         return;
+      size_t capacity = group::width;
+      while (max_load(capacity) < n)
+         capacity *= 2;
+      rehash(capacity);
+   }
+
+private:
+   // Keep the table at most 7/8 full, or probe sequences get long.
+   static size_t max_load(size_t capacity)
+   {
+      return capacity - capacity / 8;
+   }
+
+   static uint64_t hash_of(const K key)
+   {
+      return static_cast<uint64_t>(Hash()(key));
+   }
+
+   static int8_t h2(uint64_t hash)
+   {
+      return static_cast<int8_t>(hash & 0x7F);
+   }
+
+   value_type* slot(size_t index) const
+   {
+      return reinterpret_cast<value_type*>(m_slots) + index;
+   }
+
+   size_t next_full(size_t index) const
+   {
+      while (index < m_capacity && m_ctrl[index] < 0)
+         ++index;
+      return index;
+   }
+
+   // Probes group by group. Triangular steps over a power-of-two group count
+   // visit every group exactly once.
+   size_t find_index(const K key) const
+   {
+      return find_index(key, hash_of(key));
+   }
+
+   size_t find_index(const K key, uint64_t hash) const
+   {
+      if (!m_capacity)
+         return 0;
+
+      const size_t group_mask = m_capacity / group::width - 1;
+      size_t g = static_cast<size_t>(hash >> 7) & group_mask;
+      for (size_t step = 1; ; ++step)
+      {
+         const group grp(m_ctrl + g * group::width);
+         for (uint32_t m = grp.match(h2(hash)); m != 0; m &= m - 1)
+         {
+            const size_t index = g * group::width + detail::lowest_set_bit(m);
+            if (slot(index)->first == key)
+               return index;
+         }
+         if (grp.match_empty() || step > group_mask)
+            return m_capacity;
+         g = (g + step) & group_mask;
+      }
+   }
+
+   size_t find_insert_index(uint64_t hash) const
+   {
+      const size_t group_mask = m_capacity / group::width - 1;
+      size_t g = static_cast<size_t>(hash >> 7) & group_mask;
+      for (size_t step = 1; ; ++step)
+      {
+         const uint32_t m = group(m_ctrl + g * group::width).match_empty_or_deleted();
+         if (m)
+            return g * group::width + detail::lowest_set_bit(m);
+         g = (g + step) & group_mask;
+      }
+   }
+
+   void erase_index(size_t index)
+   {
+      slot(index)->~value_type();
+      --m_size;
+
+      // A lookup only moves past a group that has no empty slots. If this
+      // group still has one, nobody can be relying on it being full, so the
+      // slot can go straight back to empty instead of leaving a tombstone.
+      const size_t group_start = index - index % group::width;
+      if (group(m_ctrl + group_start).match_empty())
+      {
+         m_ctrl[index] = detail::kCtrlEmpty;
+         ++m_growth_left;
+      }
+      else
+      {
+         m_ctrl[index] = detail::kCtrlDeleted;
+      }
+   }
+
+   void rehash_for_insert()
+   {
+      // If most of the used space is tombstones, rehashing in place (well,
+      // at the same size) is enough to get it back.
+      if (m_capacity && m_size < max_load(m_capacity) / 2)
+         rehash(m_capacity);
+      else
+         rehash(m_capacity ? m_capacity * 2 : group::width);
+   }
+
+   void rehash(size_t new_capacity)
+   {
+      int8_t* old_ctrl = m_ctrl;
+      unsigned char* old_slots = m_slots;
+      const size_t old_capacity = m_capacity;
+
+      allocate(new_capacity);
+      for (size_t i = 0; i < old_capacity; ++i)
+      {
+         if (old_ctrl[i] < 0)
+            continue;
+
+         value_type* old = reinterpret_cast<value_type*>(old_slots) + i;
+         const uint64_t hash = hash_of(old->first);
+         const size_t index = find_insert_index(hash);
+         ::new (static_cast<void*>(slot(index))) value_type(old->first, std::move(old->second));
+         m_ctrl[index] = h2(hash);
+         --m_growth_left;
+         ++m_size;
+         old->~value_type();
+      }
+
+      deallocate(old_ctrl, old_slots);
+   }
+
+   // Sets up empty storage for new_capacity slots. Doesn't free the old storage.
+   void allocate(size_t new_capacity)
+   {
+      // Control bytes are loaded 16 at a time with aligned loads.
+      m_ctrl = static_cast<int8_t*>(::operator new(new_capacity + group::width));
+      int8_t* aligned = reinterpret_cast<int8_t*>(
+         (reinterpret_cast<uintptr_t>(m_ctrl) + group::width) & ~uintptr_t(group::width - 1));
+      // Remember how far we moved so deallocate can find the real pointer.
+      aligned[-1] = static_cast<int8_t>(aligned - m_ctrl);
+      m_ctrl = aligned;
+      std::memset(m_ctrl, detail::kCtrlEmpty, new_capacity);
+
+      m_slots = static_cast<unsigned char*>(::operator new(new_capacity * sizeof(value_type)));
+      m_capacity = new_capacity;
+      m_size = 0;
+      m_growth_left = max_load(new_capacity);
+   }
+
+   static void deallocate(int8_t* ctrl, unsigned char* slots)
+   {
+      if (!ctrl)
+         return;
+      ::operator delete(ctrl - ctrl[-1]);
+      ::operator delete(slots);
+   }
+
+   void destroy()
+   {
+      for (size_t i = 0; i < m_capacity; ++i)
+      {
+         if (m_ctrl[i] >= 0)
+            slot(i)->~value_type();
+      }
+      deallocate(m_ctrl, m_slots);
+      m_ctrl = nullptr;
+      m_slots = nullptr;
+      m_capacity = m_size = m_growth_left = 0;
+   }
+
+   int8_t* m_ctrl;
+   unsigned char* m_slots;
+   size_t m_capacity;     // always 0 or a power of two >= 16
+   size_t m_size;
+   size_t m_growth_left;  // empty slots we can still fill before rehashing
+};
+
+} // namespace cppbits
@@ -44,6 +44,9 @@
 // This file is released into the public domain. See LICENCE for more information.
 // ===============================================================================
 
+#pragma once
+
+#include <algorithm>
 #include <string>
 #include <iostream>
 #include <sstream>
@@ -55,6 +58,10 @@
 
 namespace cppbits {
 
+// Defined at the bottom of this file; clients may specialize it.
+template<class T>
+void print(const T& arg, std::ostream& o, size_t width, char specifier, size_t precision);
+
 namespace detail {
 
 // Saves the flags, precision, and width settings of a particular
@@ -83,7 +90,7 @@ private:
 	std::streamsize width;
 };
 
-static void default_format_handler(std::ostream& o, size_t width, char specifier, size_t precision)
+inline void default_format_handler(std::ostream& o, size_t width, char specifier, size_t precision)
 {
 	if (isupper(specifier))
 		o << std::uppercase;
@@ -142,38 +149,36 @@ struct formattable_object : public formattable
 
 // init_array recursively fills the array with formattable_object<T> containers
 // for all the values in the parameter pack.
-template<int A, int N, class First, class ... Rest>
+template<size_t A, size_t N, class First, class ... Rest>
 void init_array_helper(std::array<std::unique_ptr<formattable>, A>& ary, First obj, Rest ... rest)
 {
 	ary[N].reset(static_cast<formattable*>(new formattable_object<First>(std::forward<First>(obj))));
 	init_array_helper<A, N + 1, Rest...>(ary, std::forward<Rest>(rest)...);
 }
 
-template<int A, int N, class First>
+template<size_t A, size_t N, class First>
 void init_array_helper(std::array<std::unique_ptr<formattable>, A>& ary, First obj)
 {
 	ary[N].reset(static_cast<formattable*>(new formattable_object<First>(std::forward<First>(obj))));
 }
 
-template<int A, class ... Args>
+template<size_t A, class ... Args>
 void init_array(std::array<std::unique_ptr<formattable>, A>& ary, Args ... args)
 {
 	init_array_helper<A, 0, Args ...>(ary, std::forward<Args>(args)...);
 }
 
+// A format string with no arguments has nothing to fill in.
+template<size_t A>
+void init_array(std::array<std::unique_ptr<formattable>, A>&)
+{
+}
+
 template<class ... T>
 struct formatter {
-	formatter(const std::string& fmt) :
-		m_fmt(fmt)
-	{}
-
-	formatter(const std::string& fmt, const T&... args) :
-		m_fmt(fmt)
-	{
-		init_array(m_args, std::forward<T>(args)...);
-	}
-
-	formatter(const std::string& fmt, T&&... args) :
+	// A single constructor taking the arguments by value; separate const T&
+	// and T&& overloads collapse into duplicates when T is empty.
+	formatter(const std::string& fmt, T... args) :
 		m_fmt(fmt)
 	{
 		init_array(m_args, std::forward<T>(args)...);
@@ -195,7 +200,7 @@ struct formatter {
 // Parse a format string and pull out argument index, field width, specifier, and
 // precision parameters.
 // TODO: This parser is really sloppy!
-void parse_format_item_helper(
+inline void parse_format_item_helper(
 	std::string::const_iterator begin,
 	std::string::const_iterator end,
 	size_t& argument,
@@ -293,7 +298,7 @@ detail::formatter<T...> format(const std::string& str, T... args)
 }
 
 template<class T>
-static void print(const T& arg, std::ostream& o, size_t width, char specifier, size_t precision)
+void print(const T& arg, std::ostream& o, size_t width, char specifier, size_t precision)
 {
 	detail::default_format_handler(o, width, specifier, precision);
 	o << arg;
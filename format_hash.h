@@ -0,0 +1,122 @@
+// Hashing of cppbits::format output without building the string first.
+//
+// A common pattern is to build a cache key with cppbits::format and then
+// immediately hash it:
+//
+//    std::string key = cppbits::format("{0}/{1}", bucket, id);
+//    auto it = cache.find(key);
+//
+// which allocates and fills a std::string only to throw it away. Instead,
+// cppbits::format_hash renders the format string straight into a streaming
+// hash and returns the result:
+//
+//    uint64_t key = cppbits::format_hash("{0}/{1}", bucket, id);
+//
+// The hash is 64-bit FNV-1a. It consumes one byte at a time, so it gives the
+// same value no matter how the output is split up while rendering, which is
+// what lets us guarantee:
+//
+//    cppbits::format_hash(fmt, args...) ==
+//       cppbits::hash_string(std::string(cppbits::format(fmt, args...)))
+//
+// Use hash_string (or fnv1a_hasher directly) when you need to hash a string
+// you already have so that it matches keys produced by format_hash.
+//
+// ===============================================================================
+// This file is released into the public domain. See LICENCE for more information.
+// ===============================================================================
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <streambuf>
+#include <string>
+
+#include "format.h"
+
+namespace cppbits {
+
+// Streaming 64-bit FNV-1a. Feeding the same bytes in any number of pieces
+// gives the same result.
+class fnv1a_hasher
+{
+public:
+	static const uint64_t offset_basis = 14695981039346656037ULL;
+	static const uint64_t prime = 1099511628211ULL;
+
+	fnv1a_hasher() : m_state(offset_basis) {}
+
+	void update(char c)
+	{
+		m_state = (m_state ^ static_cast<unsigned char>(c)) * prime;
+	}
+
+	void update(const char* data, size_t length)
+	{
+		uint64_t state = m_state;
+		for (size_t i = 0; i < length; ++i)
+			state = (state ^ static_cast<unsigned char>(data[i])) * prime;
+		m_state = state;
+	}
+
+	uint64_t value() const { return m_state; }
+
+private:
+	uint64_t m_state;
+};
+
+inline uint64_t hash_string(const char* data, size_t length)
+{
+	fnv1a_hasher hasher;
+	hasher.update(data, length);
+	return hasher.value();
+}
+
+inline uint64_t hash_string(const std::string& str)
+{
+	return hash_string(str.data(), str.size());
+}
+
+namespace detail {
+
+// A std::streambuf that has no storage at all; everything written to it
+// just gets fed into a fnv1a_hasher.
+class hashing_streambuf : public std::streambuf
+{
+public:
+	uint64_t value() const { return m_hasher.value(); }
+
+protected:
+	virtual int_type overflow(int_type ch)
+	{
+		if (!traits_type::eq_int_type(ch, traits_type::eof()))
+			m_hasher.update(traits_type::to_char_type(ch));
+		return traits_type::not_eof(ch);
+	}
+
+	virtual std::streamsize xsputn(const char* s, std::streamsize count)
+	{
+		m_hasher.update(s, static_cast<size_t>(count));
+		return count;
+	}
+
+private:
+	fnv1a_hasher m_hasher;
+};
+
+} // namespace detail
+
+// Equivalent to hash_string(cppbits::format(str, args...)), without ever
+// materializing the formatted string.
+template<class ... T>
+uint64_t format_hash(const std::string& str, T... args)
+{
+	detail::hashing_streambuf buf;
+	std::ostream o(&buf);
+	o << format(str, std::forward<T>(args)...);
+	return buf.value();
+}
+
+} // namespace cppbits
@@ -0,0 +1,309 @@
+// Scratch-space formatting for strings that only live for one scope.
+//
+// Requires C++17 (std::string_view).
+//
+// A lot of formatted strings exist only long enough to be handed to a C API:
+//
+//    std::string path = cppbits::format("{0}/{1}.log", dir, id);
+//    fd = open(path.c_str(), O_RDONLY);
+//
+// format_temp renders into a per-thread bump buffer instead, so the string
+// costs a pointer bump rather than a heap allocation. Everything allocated
+// inside a temp_scope is released, all at once, when the scope ends:
+//
+//    {
+//       cppbits::temp_scope scope;
+//       std::string_view path = cppbits::format_temp("{0}/{1}.log", dir, id);
+//       fd = open(path.data(), O_RDONLY); // always NUL-terminated
+//    } // path is dangling from here on
+//
+// Scopes nest; an inner scope only releases what was allocated inside it.
+// Never let a format_temp result outlive its scope, and don't hang on to a
+// temp_scope across threads (the buffer is per-thread).
+//
+// The buffer grows in chunks as needed and keeps them around for the next
+// scope, so steady-state use doesn't allocate at all.
+//
+// Debug checks (when NDEBUG isn't defined):
+// - format_temp asserts that there's an open temp_scope on this thread.
+// - temp_scopes must be destroyed in reverse order of creation.
+// - Released memory is overwritten with 0xDD, so use-after-scope shows up as
+//   obvious garbage instead of quietly reading stale-but-plausible text.
+// Under AddressSanitizer, released memory is also poisoned, so any
+// use-after-scope gets reported at the point of access.
+//
+// ===============================================================================
+// This file is released into the public domain. See LICENCE for more information.
+// ===============================================================================
+
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "format.h"
+
+#if defined(__SANITIZE_ADDRESS__)
+	#define CPPBITS_TEMP_ASAN
+#elif defined(__has_feature)
+	#if __has_feature(address_sanitizer)
+		#define CPPBITS_TEMP_ASAN
+	#endif
+#endif
+
+#if defined(CPPBITS_TEMP_ASAN)
+	#include <sanitizer/asan_interface.h>
+#endif
+
+namespace cppbits {
+
+namespace detail {
+
+// The per-thread bump allocator behind format_temp.
+class temp_arena
+{
+public:
+	struct mark
+	{
+		size_t chunk;
+		size_t offset;
+		size_t depth;
+	};
+
+	static const size_t kDefaultChunkSize = 16 * 1024;
+
+	static temp_arena& current()
+	{
+		static thread_local temp_arena arena;
+		return arena;
+	}
+
+	mark push_scope()
+	{
+		mark m = { m_chunk, m_offset, m_depth };
+		++m_depth;
+		return m;
+	}
+
+	void pop_scope(const mark& m)
+	{
+		assert(m_depth == m.depth + 1 && "temp_scope: scopes must be destroyed in reverse order");
+
+		// Everything from the mark to the current top is now free.
+		for (size_t i = m.chunk; i <= m_chunk && i < m_chunks.size(); ++i)
+		{
+			const size_t begin = (i == m.chunk) ? m.offset : 0;
+			const size_t end = (i == m_chunk) ? m_offset : m_chunks[i].used;
+			release(m_chunks[i].data.get() + begin, end - begin);
+		}
+
+		m_chunk = m.chunk;
+		m_offset = m.offset;
+		m_depth = m.depth;
+	}
+
+	size_t depth() const { return m_depth; }
+
+	// Returns the free space at the top of the current chunk; may be empty.
+	char* top(size_t& available)
+	{
+		if (m_chunk >= m_chunks.size())
+		{
+			available = 0;
+			return nullptr;
+		}
+		available = m_chunks[m_chunk].size - m_offset;
+		return m_chunks[m_chunk].data.get() + m_offset;
+	}
+
+	// Moves to a chunk with at least size bytes free, carrying over the
+	// keep bytes (a partially rendered string) from the old top.
+	void grow(size_t size, const char* keep, size_t keep_size)
+	{
+		const bool had_chunk = m_chunk < m_chunks.size();
+		if (had_chunk)
+		{
+			m_chunks[m_chunk].used = m_offset;
+			++m_chunk;
+		}
+
+		// Chunks above the top are all free, so one that is too small can
+		// simply be replaced.
+		if (m_chunk == m_chunks.size())
+			m_chunks.push_back(chunk());
+		if (m_chunks[m_chunk].size < size)
+		{
+			const size_t wanted = size > kDefaultChunkSize ? size * 2 : kDefaultChunkSize;
+			m_chunks[m_chunk].data.reset(new char[wanted]);
+			m_chunks[m_chunk].size = wanted;
+			release(m_chunks[m_chunk].data.get(), wanted);
+		}
+
+		m_offset = 0;
+		if (keep_size)
+		{
+			char* p = m_chunks[m_chunk].data.get();
+			acquire(p, keep_size);
+			std::memcpy(p, keep, keep_size);
+		}
+
+		// Whatever was left in the old chunk goes unused until the scope ends.
+		if (had_chunk)
+		{
+			chunk& old = m_chunks[m_chunk - 1];
+			release(old.data.get() + old.used, old.size - old.used);
+		}
+	}
+
+	// Marks bytes at the top as in use.
+	void commit(size_t size)
+	{
+		acquire(m_chunks[m_chunk].data.get() + m_offset, size);
+		m_offset += size;
+	}
+
+	// Lets bytes at the top be written to, without committing them.
+	void acquire(char* p, size_t size)
+	{
+#if defined(CPPBITS_TEMP_ASAN)
+		ASAN_UNPOISON_MEMORY_REGION(p, size);
+#else
+		(void)p;
+		(void)size;
+#endif
+	}
+
+	// Undoes acquire for bytes that were never written to. They still hold
+	// the fill from when they were released, so only ASan needs telling.
+	static void unacquire(char* p, size_t size)
+	{
+#if defined(CPPBITS_TEMP_ASAN)
+		ASAN_POISON_MEMORY_REGION(p, size);
+#else
+		(void)p;
+		(void)size;
+#endif
+	}
+
+	// Marks bytes as free again.
+	static void release(char* p, size_t size)
+	{
+		if (!size)
+			return;
+#if !defined(NDEBUG)
+		std::memset(p, 0xDD, size);
+#endif
+#if defined(CPPBITS_TEMP_ASAN)
+		ASAN_POISON_MEMORY_REGION(p, size);
+#endif
+		(void)p;
+	}
+
+private:
+	struct chunk
+	{
+		chunk() : size(0), used(0) {}
+		std::unique_ptr<char[]> data;
+		size_t size;
+		size_t used; // only meaningful for chunks below the top
+	};
+
+	temp_arena() : m_chunk(0), m_offset(0), m_depth(0) {}
+
+	std::vector<chunk> m_chunks;
+	size_t m_chunk;
+	size_t m_offset;
+	size_t m_depth;
+};
+
+// Writes directly into the free space at the top of the temp_arena, moving
+// to a bigger chunk if the output doesn't fit.
+class temp_streambuf : public std::streambuf
+{
+public:
+	explicit temp_streambuf(temp_arena& arena) : m_arena(arena)
+	{
+		reset_put_area(0);
+	}
+
+	// Terminates the output and commits it to the arena.
+	std::string_view finish()
+	{
+		sputc('\0');
+		const size_t length = static_cast<size_t>(pptr() - pbase());
+		m_arena.commit(length);
+		temp_arena::unacquire(pptr(), static_cast<size_t>(epptr() - pptr()));
+		return std::string_view(pbase(), length - 1);
+	}
+
+protected:
+	virtual int_type overflow(int_type ch)
+	{
+		const size_t length = static_cast<size_t>(pptr() - pbase());
+		m_arena.grow((length + 1) * 2, pbase(), length);
+		reset_put_area(length);
+
+		if (!traits_type::eq_int_type(ch, traits_type::eof()))
+			sputc(traits_type::to_char_type(ch));
+		return traits_type::not_eof(ch);
+	}
+
+private:
+	// Makes all the free space at the top of the arena writable, with
+	// length bytes already written.
+	void reset_put_area(size_t length)
+	{
+		size_t available;
+		char* p = m_arena.top(available);
+		m_arena.acquire(p, available);
+		setp(p, p + available);
+		pbump(static_cast<int>(length));
+	}
+
+	temp_arena& m_arena;
+};
+
+} // namespace detail
+
+// Releases everything format_temp allocated on this thread while it was alive.
+class temp_scope
+{
+public:
+	temp_scope() :
+		m_mark(detail::temp_arena::current().push_scope())
+	{}
+
+	~temp_scope()
+	{
+		detail::temp_arena::current().pop_scope(m_mark);
+	}
+
+	temp_scope(const temp_scope&) = delete;
+	temp_scope& operator=(const temp_scope&) = delete;
+
+private:
+	detail::temp_arena::mark m_mark;
+};
+
+// Renders into the current thread's scratch buffer. The result is
+// NUL-terminated and valid until the innermost enclosing temp_scope ends.
+template<class ... T>
+std::string_view format_temp(const std::string& str, T... args)
+{
+	detail::temp_arena& arena = detail::temp_arena::current();
+	assert(arena.depth() > 0 && "format_temp called outside of a temp_scope");
+
+	detail::temp_streambuf buf(arena);
+	std::ostream o(&buf);
+	o << format(str, std::forward<T>(args)...);
+	return buf.finish();
+}
+
+} // namespace cppbits
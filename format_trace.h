@@ -0,0 +1,890 @@
+// Capturing real cppbits::format traffic, and replaying it as a benchmark.
+//
+// Microbenchmarks of a single format call don't tell you much about a real
+// logging pipeline, where formatting, buffering, sinks, and lock contention
+// between threads all interact. This file lets you record the format calls an
+// application actually makes, and then replay that trace through whatever
+// formatting/sink setup you want to evaluate, from the same number of threads
+// and (optionally) with the same timing.
+//
+// RECORDING:
+//
+//    Build with CPPBITS_FORMAT_TRACE defined, and route the calls you care
+//    about through CPPBITS_TRACE_FORMAT instead of cppbits::format:
+//
+//       log << CPPBITS_TRACE_FORMAT("{0} served {1} in {2}ms", peer, path, ms);
+//
+//    Without CPPBITS_FORMAT_TRACE this is exactly cppbits::format(...). With
+//    it, each call also records the format string, its arguments, the
+//    calling thread, and a timestamp. Save the trace when you're done:
+//
+//       std::ofstream out("app.trace");
+//       cppbits::trace_recorder::instance().save(out);
+//
+//    Integers, floating-point values, characters, strings, and unscoped
+//    enums (as their underlying type) are recorded as their own types, so
+//    specifiers like {0:X} behave the same on replay.
+//    Anything else is recorded as the text its operator<< produced. A call
+//    can have at most kMaxTraceArgs arguments.
+//
+//    Each call site looks its format string up once and caches the ID, so
+//    the format string at a given call site must not change from call to
+//    call (it's normally a literal anyway). Calls are appended to a
+//    per-thread buffer; threads only ever contend with save() and clear().
+//
+// REPLAYING:
+//
+//       std::ifstream in("app.trace");
+//       cppbits::format_trace trace = cppbits::load_trace(in);
+//
+//       std::ofstream sink("/dev/null");
+//       std::mutex sink_lock;
+//
+//       cppbits::replay_options options;
+//       options.speed = 4.0; // 4x faster than recorded; 0 means flat out
+//
+//       cppbits::replay_report report = cppbits::replay(trace, options,
+//          [&](const cppbits::trace_call& call) {
+//             std::lock_guard<std::mutex> lock(sink_lock);
+//             cppbits::render_call(trace, call, sink);
+//             sink << '\n';
+//          });
+//
+//       cppbits::print_report(std::cout, report);
+//
+//    Each recorded thread gets its own replay thread. The report has the
+//    throughput and percentiles of the handler's run time per call (service
+//    time). Paced replays also report response time, measured from when
+//    each call was scheduled, so a handler that falls behind shows up as
+//    latency instead of just as fewer calls per second.
+//
+// ALLOCATION COUNTING:
+//
+//    To also count heap allocations made during replay, define
+//    CPPBITS_FORMAT_TRACE_COUNT_ALLOCATIONS before including this file in
+//    exactly one translation unit of the benchmark program. That replaces
+//    every replaceable global operator new/delete (including the nothrow and,
+//    with C++17, the aligned forms) with counting versions.
+//
+// ===============================================================================
+// This file is released into the public domain. See LICENCE for more information.
+// ===============================================================================
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <istream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "format.h"
+
+namespace cppbits {
+
+// One recorded argument. Streams the same way the original value did.
+struct trace_value
+{
+	enum kind_type
+	{
+		kNone,
+		kSigned,
+		kUnsigned,
+		kFloat,
+		kString
+	};
+
+	trace_value() : kind(kNone), i(0), u(0), d(0) {}
+
+	kind_type kind;
+	int64_t i;
+	uint64_t u;
+	double d;
+	std::string s;
+
+	friend std::ostream& operator<<(std::ostream& o, const trace_value& v)
+	{
+		switch (v.kind)
+		{
+			case kSigned: return o << v.i;
+			case kUnsigned: return o << v.u;
+			case kFloat: return o << v.d;
+			case kString: return o << v.s;
+			default: return o;
+		}
+	}
+};
+
+// The most arguments a traced call can have.
+static const size_t kMaxTraceArgs = 16;
+
+struct trace_call
+{
+	uint64_t timestamp_ns; // since the start of the recording
+	uint32_t thread;       // small per-trace thread index
+	uint32_t format_id;    // index into format_trace::formats
+	std::vector<trace_value> args;
+};
+
+struct format_trace
+{
+	std::vector<std::string> formats; // indexed by format_id
+	std::vector<trace_call> calls;     // in timestamp order
+	uint32_t thread_count;
+
+	format_trace() : thread_count(0) {}
+};
+
+namespace detail {
+
+template<class T>
+typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value, trace_value>::type
+	make_trace_value_helper(const T& arg)
+{
+	trace_value v;
+	v.kind = trace_value::kSigned;
+	v.i = arg;
+	return v;
+}
+
+template<class T>
+typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value, trace_value>::type
+	make_trace_value_helper(const T& arg)
+{
+	trace_value v;
+	v.kind = trace_value::kUnsigned;
+	v.u = arg;
+	return v;
+}
+
+template<class T>
+typename std::enable_if<std::is_floating_point<T>::value, trace_value>::type
+	make_trace_value_helper(const T& arg)
+{
+	trace_value v;
+	v.kind = trace_value::kFloat;
+	v.d = arg;
+	return v;
+}
+
+// Characters stream as characters, not numbers.
+inline trace_value make_trace_value_char(char c)
+{
+	trace_value v;
+	v.kind = trace_value::kString;
+	v.s.assign(1, c);
+	return v;
+}
+
+// Declared up front so the enum overload below can use the character ones.
+template<class T>
+trace_value make_trace_value(const T& arg);
+inline trace_value make_trace_value(const char& arg);
+inline trace_value make_trace_value(const signed char& arg);
+inline trace_value make_trace_value(const unsigned char& arg);
+
+template<class T, bool = std::is_enum<T>::value>
+struct is_unscoped_enum : std::false_type
+{ };
+
+template<class T>
+struct is_unscoped_enum<T, true> : std::is_convertible<T, typename std::underlying_type<T>::type>
+{ };
+
+// Unscoped enums (enum_flags types, usually) stream as their underlying
+// type, so record that; {0:X} has to come out the same on replay. Like
+// std::ostream, char-based enums end up as characters.
+template<class T>
+typename std::enable_if<is_unscoped_enum<T>::value, trace_value>::type
+	make_trace_value_helper(const T& arg)
+{
+	return make_trace_value(static_cast<typename std::underlying_type<T>::type>(arg));
+}
+
+template<class T>
+typename std::enable_if<!std::is_arithmetic<T>::value && !is_unscoped_enum<T>::value, trace_value>::type
+	make_trace_value_helper(const T& arg)
+{
+	// Strings end up here too; for them this is lossless.
+	std::ostringstream ss;
+	ss << arg;
+	trace_value v;
+	v.kind = trace_value::kString;
+	v.s = ss.str();
+	return v;
+}
+
+template<class T>
+trace_value make_trace_value(const T& arg)
+{
+	return make_trace_value_helper(arg);
+}
+
+inline trace_value make_trace_value(const char& arg) { return make_trace_value_char(arg); }
+inline trace_value make_trace_value(const signed char& arg) { return make_trace_value_char(static_cast<char>(arg)); }
+inline trace_value make_trace_value(const unsigned char& arg) { return make_trace_value_char(static_cast<char>(arg)); }
+
+inline void push_trace_values(std::vector<trace_value>&)
+{
+}
+
+template<class First, class ... Rest>
+void push_trace_values(std::vector<trace_value>& out, const First& first, const Rest&... rest)
+{
+	out.push_back(make_trace_value(first));
+	push_trace_values(out, rest...);
+}
+
+// Escaping for the tab-separated trace file.
+inline void write_escaped(std::ostream& o, const std::string& str)
+{
+	for (char c : str)
+	{
+		switch (c)
+		{
+			case '\\': o << "\\\\"; break;
+			case '\t': o << "\\t"; break;
+			case '\n': o << "\\n"; break;
+			case '\r': o << "\\r"; break;
+			default: o << c; break;
+		}
+	}
+}
+
+inline std::string unescape(const std::string& str)
+{
+	std::string result;
+	result.reserve(str.size());
+	for (size_t i = 0; i < str.size(); ++i)
+	{
+		if (str[i] != '\\' || i + 1 == str.size())
+		{
+			result.push_back(str[i]);
+			continue;
+		}
+		switch (str[++i])
+		{
+			case 't': result.push_back('\t'); break;
+			case 'n': result.push_back('\n'); break;
+			case 'r': result.push_back('\r'); break;
+			default: result.push_back(str[i]); break;
+		}
+	}
+	return result;
+}
+
+inline std::vector<std::string> split_tabs(const std::string& line)
+{
+	std::vector<std::string> fields;
+	size_t start = 0;
+	for (;;)
+	{
+		const size_t tab = line.find('\t', start);
+		fields.push_back(line.substr(start, tab == std::string::npos ? std::string::npos : tab - start));
+		if (tab == std::string::npos)
+			return fields;
+		start = tab + 1;
+	}
+}
+
+struct allocation_counters
+{
+	std::atomic<uint64_t> count;
+	std::atomic<uint64_t> bytes;
+	bool enabled;
+};
+
+inline allocation_counters& trace_allocation_counters()
+{
+	static allocation_counters counters = { {0}, {0}, false };
+	return counters;
+}
+
+// The cached format ID for one CPPBITS_TRACE_FORMAT call site. Constant
+// initialized, so a function-local static of it costs no guard.
+struct trace_site
+{
+	enum : uint32_t { kUnregistered = 0xFFFFFFFFu };
+
+	constexpr trace_site() : id(kUnregistered) {}
+
+	std::atomic<uint32_t> id;
+};
+
+} // namespace detail
+
+// Collects format calls made through CPPBITS_TRACE_FORMAT.
+class trace_recorder
+{
+public:
+	static trace_recorder& instance()
+	{
+		static trace_recorder recorder;
+		return recorder;
+	}
+
+	template<class ... T>
+	void record(detail::trace_site& site, const std::string& fmt, const T&... args)
+	{
+		static_assert(sizeof...(T) <= kMaxTraceArgs, "too many arguments to trace; see kMaxTraceArgs");
+
+		uint32_t format_id = site.id.load(std::memory_order_acquire);
+		if (format_id == detail::trace_site::kUnregistered)
+		{
+			format_id = register_format(fmt);
+			site.id.store(format_id, std::memory_order_release);
+		}
+
+		thread_buffer& buffer = current_thread_buffer();
+
+		trace_call call;
+		call.timestamp_ns = static_cast<uint64_t>(now_ns() - m_start_ns.load(std::memory_order_relaxed));
+		call.thread = buffer.thread;
+		call.format_id = format_id;
+		call.args.reserve(sizeof...(T));
+		detail::push_trace_values(call.args, args...);
+
+		// Only save() and clear() ever take this lock from another thread.
+		std::lock_guard<std::mutex> lock(buffer.mutex);
+		buffer.calls.push_back(std::move(call));
+	}
+
+	// Writes the trace recorded so far. The format is line-based text:
+	//    F <tab> id <tab> format string
+	//    C <tab> timestamp_ns <tab> thread <tab> format id { <tab> kind:value }
+	// where kind is i, u, f, or s, and tabs/newlines/backslashes are escaped.
+	void save(std::ostream& o)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		for (size_t i = 0; i < m_formats.size(); ++i)
+		{
+			o << "F\t" << i << '\t';
+			detail::write_escaped(o, m_formats[i]);
+			o << '\n';
+		}
+
+		// Merge the per-thread buffers into one timeline.
+		std::vector<std::unique_lock<std::mutex>> buffer_locks;
+		std::vector<const trace_call*> sorted;
+		for (const std::unique_ptr<thread_buffer>& buffer : m_threads)
+		{
+			buffer_locks.push_back(std::unique_lock<std::mutex>(buffer->mutex));
+			for (const trace_call& call : buffer->calls)
+				sorted.push_back(&call);
+		}
+		std::stable_sort(sorted.begin(), sorted.end(), [](const trace_call* a, const trace_call* b) {
+			return a->timestamp_ns < b->timestamp_ns;
+		});
+
+		const std::streamsize old_precision = o.precision(17);
+		for (const trace_call* call : sorted)
+		{
+			o << "C\t" << call->timestamp_ns << '\t' << call->thread << '\t' << call->format_id;
+			for (const trace_value& v : call->args)
+			{
+				switch (v.kind)
+				{
+					case trace_value::kSigned: o << "\ti:" << v.i; break;
+					case trace_value::kUnsigned: o << "\tu:" << v.u; break;
+					case trace_value::kFloat: o << "\tf:" << v.d; break;
+					default: o << "\ts:"; detail::write_escaped(o, v.s); break;
+				}
+			}
+			o << '\n';
+		}
+		o.precision(old_precision);
+	}
+
+	// Drops every call recorded so far and restarts the clock. Format strings
+	// stay registered, since call sites have their IDs cached.
+	void clear()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (const std::unique_ptr<thread_buffer>& buffer : m_threads)
+		{
+			std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+			buffer->calls.clear();
+		}
+		m_start_ns.store(now_ns(), std::memory_order_relaxed);
+	}
+
+private:
+	struct thread_buffer
+	{
+		std::mutex mutex;
+		std::vector<trace_call> calls;
+		uint32_t thread;
+	};
+
+	trace_recorder() : m_start_ns(now_ns()) {}
+
+	static int64_t now_ns()
+	{
+		return static_cast<int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count());
+	}
+
+	// Called once per call site (more if several threads race to it first).
+	uint32_t register_format(const std::string& fmt)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto itr = m_format_ids.find(fmt);
+		if (itr == m_format_ids.end())
+		{
+			itr = m_format_ids.insert(std::make_pair(fmt, static_cast<uint32_t>(m_formats.size()))).first;
+			m_formats.push_back(fmt);
+		}
+		return itr->second;
+	}
+
+	// The calling thread's buffer, created the first time it records. The
+	// recorder owns it, so the calls outlive the thread.
+	thread_buffer& current_thread_buffer()
+	{
+		static thread_local thread_buffer* buffer = nullptr;
+		if (!buffer)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_threads.push_back(std::unique_ptr<thread_buffer>(new thread_buffer));
+			buffer = m_threads.back().get();
+			buffer->thread = static_cast<uint32_t>(m_threads.size() - 1);
+		}
+		return *buffer;
+	}
+
+	std::mutex m_mutex; // guards m_formats, m_format_ids, and m_threads
+	std::atomic<int64_t> m_start_ns;
+	std::vector<std::string> m_formats; // indexed by format ID
+	std::map<std::string, uint32_t> m_format_ids;
+	std::vector<std::unique_ptr<thread_buffer>> m_threads; // indexed by thread index
+};
+
+// Reads a trace written by trace_recorder::save. Throws std::runtime_error on
+// malformed input.
+inline format_trace load_trace(std::istream& in)
+{
+	format_trace trace;
+	std::string line;
+	while (std::getline(in, line))
+	{
+		if (line.empty())
+			continue;
+
+		const std::vector<std::string> fields = detail::split_tabs(line);
+		if (fields[0] == "F" && fields.size() == 3)
+		{
+			const size_t id = std::stoul(fields[1]);
+			if (trace.formats.size() <= id)
+				trace.formats.resize(id + 1);
+			trace.formats[id] = detail::unescape(fields[2]);
+		}
+		else if (fields[0] == "C" && fields.size() >= 4)
+		{
+			trace_call call;
+			call.timestamp_ns = std::stoull(fields[1]);
+			call.thread = static_cast<uint32_t>(std::stoul(fields[2]));
+			call.format_id = static_cast<uint32_t>(std::stoul(fields[3]));
+			if (fields.size() - 4 > kMaxTraceArgs)
+				throw std::runtime_error("format trace: call has more than kMaxTraceArgs arguments");
+			for (size_t i = 4; i < fields.size(); ++i)
+			{
+				const std::string& field = fields[i];
+				if (field.size() < 2 || field[1] != ':')
+					throw std::runtime_error("format trace: bad argument '" + field + "'");
+
+				trace_value v;
+				const std::string value = field.substr(2);
+				switch (field[0])
+				{
+					case 'i': v.kind = trace_value::kSigned; v.i = std::stoll(value); break;
+					case 'u': v.kind = trace_value::kUnsigned; v.u = std::stoull(value); break;
+					case 'f': v.kind = trace_value::kFloat; v.d = std::stod(value); break;
+					case 's': v.kind = trace_value::kString; v.s = detail::unescape(value); break;
+					default: throw std::runtime_error("format trace: bad argument '" + field + "'");
+				}
+				call.args.push_back(std::move(v));
+			}
+			if (call.thread >= trace.thread_count)
+				trace.thread_count = call.thread + 1;
+			trace.calls.push_back(std::move(call));
+		}
+		else
+		{
+			throw std::runtime_error("format trace: bad line '" + line + "'");
+		}
+	}
+
+	for (const trace_call& call : trace.calls)
+	{
+		if (call.format_id >= trace.formats.size())
+			throw std::runtime_error("format trace: call refers to an unknown format string");
+	}
+	return trace;
+}
+
+namespace detail {
+
+// Peels call.args off one at a time into a parameter pack, so any count up
+// to kMaxTraceArgs ends up in a real cppbits::format call.
+template<size_t Remaining>
+struct trace_call_renderer
+{
+	template<class ... T>
+	static void render(std::ostream& o, const std::string& fmt, const std::vector<trace_value>& args,
+		const T&... unpacked)
+	{
+		if (sizeof...(T) == args.size())
+			o << format(fmt, unpacked...);
+		else
+			trace_call_renderer<Remaining - 1>::render(o, fmt, args, unpacked..., args[sizeof...(T)]);
+	}
+};
+
+template<>
+struct trace_call_renderer<0>
+{
+	template<class ... T>
+	static void render(std::ostream& o, const std::string& fmt, const std::vector<trace_value>&,
+		const T&... unpacked)
+	{
+		o << format(fmt, unpacked...);
+	}
+};
+
+} // namespace detail
+
+// Streams cppbits::format(trace.formats[call.format_id], call.args...).
+// Throws std::out_of_range for an unknown format ID, and std::length_error for
+// more than kMaxTraceArgs arguments.
+inline void render_call(const format_trace& trace, const trace_call& call, std::ostream& o)
+{
+	const std::string& fmt = trace.formats.at(call.format_id);
+	if (call.args.size() > kMaxTraceArgs)
+		throw std::length_error("format trace: call has more than kMaxTraceArgs arguments");
+	detail::trace_call_renderer<kMaxTraceArgs>::render(o, fmt, call.args);
+}
+
+struct replay_options
+{
+	// 1.0 replays at the recorded pace, 2.0 twice as fast, and so on. 0 (or
+	// less) ignores the timestamps and replays as fast as possible.
+	double speed;
+
+	// Replays the whole trace this many times back to back.
+	unsigned iterations;
+
+	replay_options() : speed(0), iterations(1) {}
+};
+
+// Latency percentiles, in nanoseconds.
+struct latency_summary
+{
+	uint64_t p50_ns;
+	uint64_t p90_ns;
+	uint64_t p99_ns;
+	uint64_t p999_ns;
+	uint64_t max_ns;
+
+	latency_summary() : p50_ns(0), p90_ns(0), p99_ns(0), p999_ns(0), max_ns(0) {}
+};
+
+struct replay_report
+{
+	uint64_t calls;
+	double wall_seconds;
+	double calls_per_second;
+
+	// How long the handler itself took per call.
+	latency_summary service;
+
+	// Only for paced replay (speed > 0): time from when each call was
+	// scheduled to when its handler returned. Unlike service time, this
+	// includes any time a call spent waiting because earlier ones ran late,
+	// so it doesn't hide queueing when the handler can't keep up.
+	bool paced;
+	latency_summary response;
+
+	// Only filled in if CPPBITS_FORMAT_TRACE_COUNT_ALLOCATIONS is in use.
+	bool allocations_counted;
+	uint64_t allocations;
+	uint64_t allocated_bytes;
+};
+
+namespace detail {
+
+inline latency_summary summarize_latencies(const std::vector<std::vector<uint64_t>>& per_thread)
+{
+	std::vector<uint64_t> all;
+	for (const std::vector<uint64_t>& l : per_thread)
+		all.insert(all.end(), l.begin(), l.end());
+
+	latency_summary summary;
+	if (all.empty())
+		return summary;
+
+	auto percentile = [&all](double p) -> uint64_t {
+		const size_t index = std::min(all.size() - 1, static_cast<size_t>(p * all.size()));
+		std::nth_element(all.begin(), all.begin() + index, all.end());
+		return all[index];
+	};
+	summary.p50_ns = percentile(0.50);
+	summary.p90_ns = percentile(0.90);
+	summary.p99_ns = percentile(0.99);
+	summary.p999_ns = percentile(0.999);
+	summary.max_ns = *std::max_element(all.begin(), all.end());
+	return summary;
+}
+
+} // namespace detail
+
+// Replays trace on one thread per recorded thread, calling handler for each
+// call. handler is called concurrently from those threads.
+inline replay_report replay(const format_trace& trace, const replay_options& options,
+	const std::function<void(const trace_call&)>& handler)
+{
+	typedef std::chrono::steady_clock clock;
+
+	std::vector<std::vector<const trace_call*>> per_thread(trace.thread_count);
+	for (const trace_call& call : trace.calls)
+		per_thread[call.thread].push_back(&call);
+
+	std::vector<std::vector<uint64_t>> latencies(trace.thread_count);
+	std::vector<std::vector<uint64_t>> response_latencies(options.speed > 0 ? trace.thread_count : 0);
+	for (size_t t = 0; t < per_thread.size(); ++t)
+	{
+		latencies[t].reserve(per_thread[t].size() * options.iterations);
+		if (options.speed > 0)
+			response_latencies[t].reserve(per_thread[t].size() * options.iterations);
+	}
+
+	detail::allocation_counters& counters = detail::trace_allocation_counters();
+	const uint64_t allocations_before = counters.count.load();
+	const uint64_t bytes_before = counters.bytes.load();
+
+	const clock::time_point start = clock::now();
+	const uint64_t trace_length_ns = trace.calls.empty() ? 0 : trace.calls.back().timestamp_ns;
+
+	std::vector<std::thread> threads;
+	for (size_t t = 0; t < per_thread.size(); ++t)
+	{
+		threads.push_back(std::thread([&, t] {
+			for (unsigned iteration = 0; iteration < options.iterations; ++iteration)
+			{
+				for (const trace_call* call : per_thread[t])
+				{
+					clock::time_point scheduled;
+					if (options.speed > 0)
+					{
+						const double target_ns = (iteration * static_cast<double>(trace_length_ns) +
+							static_cast<double>(call->timestamp_ns)) / options.speed;
+						scheduled = start + std::chrono::duration_cast<clock::duration>(
+							std::chrono::nanoseconds(static_cast<int64_t>(target_ns)));
+						std::this_thread::sleep_until(scheduled);
+					}
+
+					const clock::time_point before = clock::now();
+					handler(*call);
+					const clock::time_point after = clock::now();
+					latencies[t].push_back(static_cast<uint64_t>(
+						std::chrono::duration_cast<std::chrono::nanoseconds>(after - before).count()));
+					if (options.speed > 0)
+					{
+						response_latencies[t].push_back(static_cast<uint64_t>(
+							std::chrono::duration_cast<std::chrono::nanoseconds>(after - scheduled).count()));
+					}
+				}
+			}
+		}));
+	}
+	for (std::thread& thread : threads)
+		thread.join();
+
+	const clock::time_point end = clock::now();
+
+	replay_report report;
+	report.allocations_counted = counters.enabled;
+	report.allocations = counters.count.load() - allocations_before;
+	report.allocated_bytes = counters.bytes.load() - bytes_before;
+
+	report.calls = 0;
+	for (const std::vector<uint64_t>& l : latencies)
+		report.calls += l.size();
+	report.wall_seconds = std::chrono::duration<double>(end - start).count();
+	report.calls_per_second = report.wall_seconds > 0 ? report.calls / report.wall_seconds : 0;
+
+	report.service = detail::summarize_latencies(latencies);
+	report.paced = options.speed > 0;
+	if (report.paced)
+		report.response = detail::summarize_latencies(response_latencies);
+
+	return report;
+}
+
+inline void print_report(std::ostream& o, const replay_report& report)
+{
+	o << format("calls:       {0}\n", report.calls);
+	o << format("wall time:   {0:f3} s\n", report.wall_seconds);
+	o << format("throughput:  {0} calls/s\n", static_cast<uint64_t>(report.calls_per_second));
+	o << format("service ns:  p50 {0}  p90 {1}  p99 {2}  p99.9 {3}  max {4}\n",
+		report.service.p50_ns, report.service.p90_ns, report.service.p99_ns,
+		report.service.p999_ns, report.service.max_ns);
+	if (report.paced)
+	{
+		o << format("response ns: p50 {0}  p90 {1}  p99 {2}  p99.9 {3}  max {4}\n",
+			report.response.p50_ns, report.response.p90_ns, report.response.p99_ns,
+			report.response.p999_ns, report.response.max_ns);
+	}
+	if (report.allocations_counted)
+	{
+		o << format("allocations: {0} ({1} bytes, {2:f2} per call)\n",
+			report.allocations, report.allocated_bytes,
+			report.calls ? static_cast<double>(report.allocations) / report.calls : 0.0);
+	}
+}
+
+namespace detail {
+
+template<class ... T>
+formatter<T...> trace_format(trace_site& site, const std::string& str, T... args)
+{
+	trace_recorder::instance().record(site, str, args...);
+	return format(str, std::forward<T>(args)...);
+}
+
+} // namespace detail
+
+} // namespace cppbits
+
+#if defined(CPPBITS_FORMAT_TRACE)
+	// The lambda gives every call site its own trace_site.
+	#define CPPBITS_TRACE_FORMAT(...) ([&]() { \
+			static ::cppbits::detail::trace_site cppbits_trace_site; \
+			return ::cppbits::detail::trace_format(cppbits_trace_site, __VA_ARGS__); \
+		}())
+#else
+	#define CPPBITS_TRACE_FORMAT(...) ::cppbits::format(__VA_ARGS__)
+#endif
+
+#if defined(CPPBITS_FORMAT_TRACE_COUNT_ALLOCATIONS)
+
+#if defined(_MSC_VER)
+	#include <malloc.h> // _aligned_malloc
+#endif
+
+// Counting replacements for the global allocation functions. These must be
+// defined in only one translation unit.
+namespace cppbits {
+namespace detail {
+
+inline void count_allocation(std::size_t size)
+{
+	allocation_counters& counters = trace_allocation_counters();
+	counters.count.fetch_add(1, std::memory_order_relaxed);
+	counters.bytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+inline void* counted_allocate_nothrow(std::size_t size) noexcept
+{
+	count_allocation(size);
+	return std::malloc(size ? size : 1);
+}
+
+inline void* counted_allocate(std::size_t size)
+{
+	if (void* p = counted_allocate_nothrow(size))
+		return p;
+	throw std::bad_alloc();
+}
+
+#if defined(__cpp_aligned_new)
+
+inline void* counted_allocate_aligned_nothrow(std::size_t size, std::align_val_t alignment) noexcept
+{
+	count_allocation(size);
+	const std::size_t align = static_cast<std::size_t>(alignment);
+#if defined(_MSC_VER)
+	return _aligned_malloc(size ? size : 1, align);
+#else
+	void* p = nullptr;
+	return ::posix_memalign(&p, align < sizeof(void*) ? sizeof(void*) : align, size ? size : 1) == 0 ? p : nullptr;
+#endif
+}
+
+inline void* counted_allocate_aligned(std::size_t size, std::align_val_t alignment)
+{
+	if (void* p = counted_allocate_aligned_nothrow(size, alignment))
+		return p;
+	throw std::bad_alloc();
+}
+
+inline void free_aligned(void* p) noexcept
+{
+#if defined(_MSC_VER)
+	_aligned_free(p);
+#else
+	std::free(p);
+#endif
+}
+
+#endif
+
+static const bool allocation_counting_enabled = (trace_allocation_counters().enabled = true);
+
+} // namespace detail
+} // namespace cppbits
+
+// GCC sees malloc/free through the replaced operators after inlining and
+// wrongly reports them as mismatched.
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+	#pragma GCC diagnostic push
+	#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+// Every replaceable form has to be here. Leaving one out (the nothrow forms
+// used by std::stable_sort's temporary buffer, say) pairs the library's
+// allocation with our deallocation.
+void* operator new(std::size_t size) { return ::cppbits::detail::counted_allocate(size); }
+void* operator new[](std::size_t size) { return ::cppbits::detail::counted_allocate(size); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return ::cppbits::detail::counted_allocate_nothrow(size); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return ::cppbits::detail::counted_allocate_nothrow(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+
+#if defined(__cpp_aligned_new)
+void* operator new(std::size_t size, std::align_val_t alignment) { return ::cppbits::detail::counted_allocate_aligned(size, alignment); }
+void* operator new[](std::size_t size, std::align_val_t alignment) { return ::cppbits::detail::counted_allocate_aligned(size, alignment); }
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return ::cppbits::detail::counted_allocate_aligned_nothrow(size, alignment); }
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return ::cppbits::detail::counted_allocate_aligned_nothrow(size, alignment); }
+void operator delete(void* p, std::align_val_t) noexcept { ::cppbits::detail::free_aligned(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { ::cppbits::detail::free_aligned(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { ::cppbits::detail::free_aligned(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { ::cppbits::detail::free_aligned(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { ::cppbits::detail::free_aligned(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { ::cppbits::detail::free_aligned(p); }
+#endif
+
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+	#pragma GCC diagnostic pop
+#endif
+
+#endif
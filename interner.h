@@ -0,0 +1,303 @@
+// A thread-safe string interner that can take cppbits::format output directly.
+//
+// Requires C++17 (std::string_view).
+//
+// Services that build the same metric names, label sets, and route keys over
+// and over end up with millions of identical std::strings. An interner keeps
+// exactly one copy of each distinct string and hands out a stable
+// std::string_view (and a small integer ID) for it, so repeats cost a hash
+// table lookup instead of an allocation.
+//
+// intern_format renders a format string into a per-thread scratch buffer,
+// computing the hash as it goes, and then looks the result up. The scratch
+// buffer is reused, so a repeated string doesn't allocate a result string
+// (format() itself still allocates its own copies of the format string and
+// arguments).
+//
+// To use:
+//
+//    cppbits::interner names;
+//
+//    std::string_view a = names.intern_format("requests.{0}.{1}", service, code);
+//    std::string_view b = names.intern_format("requests.{0}.{1}", service, code);
+//    assert(a.data() == b.data());
+//
+//    cppbits::interner::id_type id = names.intern_format_id("route:{0}", path);
+//    std::string_view route = names.str(id);
+//
+// Interned strings are NUL-terminated, and stay valid (at the same address)
+// until the interner is destroyed. Nothing is ever removed.
+//
+// All member functions may be called concurrently. The table is split into
+// shards by hash, each with its own lock, so threads interning different
+// strings rarely contend.
+//
+// ===============================================================================
+// This file is released into the public domain. See LICENCE for more information.
+// ===============================================================================
+
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "flags_hash.h"
+#include "format.h"
+#include "format_hash.h"
+
+namespace cppbits {
+
+namespace detail {
+
+// Appends everything written to it onto a std::string, hashing it on the way.
+class hashing_append_streambuf : public std::streambuf
+{
+public:
+	explicit hashing_append_streambuf(std::string& str) : m_str(str) {}
+
+	uint64_t value() const { return m_hasher.value(); }
+
+protected:
+	virtual int_type overflow(int_type ch)
+	{
+		if (!traits_type::eq_int_type(ch, traits_type::eof()))
+		{
+			const char c = traits_type::to_char_type(ch);
+			m_hasher.update(c);
+			m_str.push_back(c);
+		}
+		return traits_type::not_eof(ch);
+	}
+
+	virtual std::streamsize xsputn(const char* s, std::streamsize count)
+	{
+		m_hasher.update(s, static_cast<size_t>(count));
+		m_str.append(s, static_cast<size_t>(count));
+		return count;
+	}
+
+private:
+	std::string& m_str;
+	fnv1a_hasher m_hasher;
+};
+
+} // namespace detail
+
+class interner
+{
+public:
+	typedef uint32_t id_type;
+
+	// shard_count is rounded up to a power of two.
+	explicit interner(size_t shard_count = 16) :
+		m_shard_bits(0)
+	{
+		while ((size_t(1) << m_shard_bits) < shard_count)
+			++m_shard_bits;
+		m_shards.reset(new shard[size_t(1) << m_shard_bits]);
+	}
+
+	interner(const interner&) = delete;
+	interner& operator=(const interner&) = delete;
+
+	std::string_view intern(std::string_view str)
+	{
+		return lookup(str, hash_string(str.data(), str.size())).view;
+	}
+
+	id_type intern_id(std::string_view str)
+	{
+		return lookup(str, hash_string(str.data(), str.size())).id;
+	}
+
+	// Same as intern(std::string(format(str, args...))), without the string.
+	template<class ... T>
+	std::string_view intern_format(const std::string& str, T... args)
+	{
+		return lookup_format(str, std::forward<T>(args)...).view;
+	}
+
+	template<class ... T>
+	id_type intern_format_id(const std::string& str, T... args)
+	{
+		return lookup_format(str, std::forward<T>(args)...).id;
+	}
+
+	// The string for an ID returned by intern_id or intern_format_id.
+	std::string_view str(id_type id) const
+	{
+		const shard& s = m_shards[id & shard_mask()];
+		std::lock_guard<std::mutex> lock(s.mutex);
+		const size_t index = id >> m_shard_bits;
+		assert(index < s.strings.size() && "interner: unknown id");
+		return s.strings[index];
+	}
+
+	// The number of distinct strings interned so far.
+	size_t size() const
+	{
+		size_t total = 0;
+		for (size_t i = 0; i <= shard_mask(); ++i)
+		{
+			std::lock_guard<std::mutex> lock(m_shards[i].mutex);
+			total += m_shards[i].strings.size();
+		}
+		return total;
+	}
+
+private:
+	struct result
+	{
+		std::string_view view;
+		id_type id;
+	};
+
+	struct slot
+	{
+		uint64_t hash;
+		uint32_t index_plus_one; // 0 means empty
+	};
+
+	struct shard
+	{
+		shard() : arena_used(0), arena_size(0) {}
+
+		mutable std::mutex mutex;
+		std::vector<slot> table; // open addressing, linear probing
+		std::vector<std::string_view> strings; // indexed by local index
+
+		// Interned characters. Chunks never move, so views into them stay valid.
+		std::vector<std::unique_ptr<char[]>> arena;
+		size_t arena_used;
+		size_t arena_size;
+	};
+
+	static const size_t kArenaChunkSize = 64 * 1024;
+	static const size_t kInitialTableSize = 64;
+
+	size_t shard_mask() const
+	{
+		return (size_t(1) << m_shard_bits) - 1;
+	}
+
+	template<class ... T>
+	result lookup_format(const std::string& str, T... args)
+	{
+		static thread_local std::string scratch;
+		scratch.clear();
+
+		detail::hashing_append_streambuf buf(scratch);
+		std::ostream o(&buf);
+		o << format(str, std::forward<T>(args)...);
+		return lookup(scratch, buf.value());
+	}
+
+	result lookup(std::string_view str, uint64_t hash)
+	{
+		// FNV-1a's low bits aren't great on their own; mix before splitting
+		// the hash between shard selection and table position.
+		const uint64_t mixed = mix64(hash);
+		const size_t shard_index = static_cast<size_t>(mixed) & shard_mask();
+		shard& s = m_shards[shard_index];
+
+		std::lock_guard<std::mutex> lock(s.mutex);
+
+		if (s.table.empty())
+			s.table.resize(kInitialTableSize, slot());
+
+		const size_t mask = s.table.size() - 1;
+		size_t pos = static_cast<size_t>(mixed >> m_shard_bits) & mask;
+		for (;; pos = (pos + 1) & mask)
+		{
+			const slot& candidate = s.table[pos];
+			if (candidate.index_plus_one == 0)
+				break;
+			if (candidate.hash == mixed && s.strings[candidate.index_plus_one - 1] == str)
+			{
+				const uint32_t index = candidate.index_plus_one - 1;
+				const result r = { s.strings[index], make_id(index, shard_index) };
+				return r;
+			}
+		}
+
+		// Not there yet; copy it into the arena.
+		const uint32_t index = static_cast<uint32_t>(s.strings.size());
+		assert(index < (uint64_t(1) << (32 - m_shard_bits)) - 1 && "interner: too many strings for 32-bit ids");
+		const std::string_view stored = store(s, str);
+		s.strings.push_back(stored);
+		s.table[pos].hash = mixed;
+		s.table[pos].index_plus_one = index + 1;
+
+		// Keep the load factor at or below 1/2.
+		if (s.strings.size() * 2 > s.table.size())
+			grow(s);
+
+		const result r = { stored, make_id(index, shard_index) };
+		return r;
+	}
+
+	id_type make_id(uint32_t index, size_t shard_index) const
+	{
+		return static_cast<id_type>((index << m_shard_bits) | shard_index);
+	}
+
+	static std::string_view store(shard& s, std::string_view str)
+	{
+		const size_t needed = str.size() + 1;
+		char* p;
+		if (needed > kArenaChunkSize / 4)
+		{
+			// Big strings get their own allocation, so they don't waste the
+			// rest of the current chunk.
+			s.arena.emplace_back(new char[needed]);
+			p = s.arena.back().get();
+			if (s.arena.size() >= 2)
+				std::swap(s.arena[s.arena.size() - 1], s.arena[s.arena.size() - 2]);
+		}
+		else
+		{
+			if (s.arena.empty() || s.arena_size - s.arena_used < needed)
+			{
+				s.arena.emplace_back(new char[kArenaChunkSize]);
+				s.arena_used = 0;
+				s.arena_size = kArenaChunkSize;
+			}
+			p = s.arena.back().get() + s.arena_used;
+			s.arena_used += needed;
+		}
+
+		std::memcpy(p, str.data(), str.size());
+		p[str.size()] = '\0';
+		return std::string_view(p, str.size());
+	}
+
+	void grow(shard& s)
+	{
+		std::vector<slot> table(s.table.size() * 2, slot());
+		const size_t mask = table.size() - 1;
+		for (const slot& old : s.table)
+		{
+			if (old.index_plus_one == 0)
+				continue;
+			size_t pos = static_cast<size_t>(old.hash >> m_shard_bits) & mask;
+			while (table[pos].index_plus_one != 0)
+				pos = (pos + 1) & mask;
+			table[pos] = old;
+		}
+		s.table.swap(table);
+	}
+
+	unsigned m_shard_bits;
+	std::unique_ptr<shard[]> m_shards;
+};
+
+} // namespace cppbits
@@ -0,0 +1,346 @@
+// Trivial relocation: moving objects to new storage with memcpy.
+//
+// When a std::vector<std::unique_ptr<T>> grows, it move-constructs every
+// element into the new buffer and then runs the destructor on every old one.
+// For unique_ptr all of that boils down to copying a pointer, but the compiler
+// generally can't prove it and ends up nulling out the source and checking it
+// again in the destructor, one element at a time.
+//
+// A type is "trivially relocatable" if moving it to a new address and
+// destroying the original is equivalent to copying its bytes. That holds for
+// every trivially copyable type (which includes all enums, so is_enum_flags
+// types are covered), and for std::unique_ptr with the default deleter.
+//
+// This file provides:
+//
+//    cppbits::is_trivially_relocatable<T>
+//       The trait. Specialize it for your own types that are safe to memcpy
+//       around, e.g. pool or arena handles that don't point to themselves:
+//
+//          namespace cppbits {
+//             template<>
+//             struct is_trivially_relocatable<my_handle> : std::true_type{};
+//          }
+//
+//    cppbits::uninitialized_relocate(first, last, dest)
+//       Moves [first, last) into uninitialized storage at dest and ends the
+//       lifetime of the originals. Uses memcpy where it can, and move
+//       construction followed by destruction otherwise.
+//
+//    cppbits::relocating_vector<T>
+//       A std::vector-like container that uses the above for growth and
+//       erase. It only has the parts of the std::vector interface that are
+//       actually needed for owning containers; add more as they come up.
+//
+//          cppbits::relocating_vector<std::unique_ptr<Widget>> widgets;
+//          widgets.push_back(std::make_unique<Widget>());
+//
+// ===============================================================================
+// This file is released into the public domain. See LICENCE for more information.
+// ===============================================================================
+
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+
+#include "make_unique.h"
+
+namespace cppbits {
+
+template<class T>
+struct is_trivially_relocatable : std::is_trivially_copyable<T>
+{ };
+
+template<class T>
+struct is_trivially_relocatable<std::unique_ptr<T, std::default_delete<T>>> : std::true_type
+{ };
+
+namespace detail {
+
+template<class T>
+T* uninitialized_relocate_impl(T* first, T* last, T* dest, std::true_type)
+{
+   const size_t count = static_cast<size_t>(last - first);
+   if (count)
+      std::memcpy(static_cast<void*>(dest), static_cast<const void*>(first), count * sizeof(T));
+   return dest + count;
+}
+
+// Constructs everything in the new storage before destroying anything in the
+// old, so if a constructor throws, every source element is still alive. Like
+// std::vector, it copies rather than moves when T's move constructor can
+// throw and T has a copy constructor, so for those types (and for nothrow
+// movable ones) the source is left exactly as it was. A move-only type whose
+// move constructor throws only gets the basic guarantee: the elements moved
+// before the throw are left moved-from.
+template<class T>
+T* uninitialized_relocate_impl(T* first, T* last, T* dest, std::false_type)
+{
+   T* out = dest;
+   try
+   {
+      for (T* p = first; p != last; ++p, ++out)
+         ::new (static_cast<void*>(out)) T(std::move_if_noexcept(*p));
+   }
+   catch (...)
+   {
+      while (out != dest)
+         (--out)->~T();
+      throw;
+   }
+
+   for (; first != last; ++first)
+      first->~T();
+   return out;
+}
+
+// Erases [dest, first) by shifting [first, last) down over it, and returns the
+// new end of the range.
+template<class T>
+T* erase_range(T* dest, T* first, T* last, std::true_type)
+{
+   for (T* p = dest; p != first; ++p)
+      p->~T();
+   const size_t count = static_cast<size_t>(last - first);
+   if (count)
+      std::memmove(static_cast<void*>(dest), static_cast<const void*>(first), count * sizeof(T));
+   return dest + count;
+}
+
+// Move-assigns over the gap and destroys what's left at the end, like
+// std::vector::erase, so every object stays alive if an assignment throws.
+template<class T>
+T* erase_range(T* dest, T* first, T* last, std::false_type)
+{
+   T* new_end = std::move(first, last, dest);
+   for (T* p = new_end; p != last; ++p)
+      p->~T();
+   return new_end;
+}
+
+} // namespace detail
+
+// Moves [first, last) into the uninitialized storage starting at dest, and
+// destroys the originals. The ranges must not overlap. Returns the end of the
+// destination range. If constructing an element throws, everything already
+// constructed at dest is destroyed and every element of [first, last) is
+// still alive; they are unchanged unless T is move-only with a throwing move
+// constructor, in which case those already moved are left moved-from.
+template<class T>
+T* uninitialized_relocate(T* first, T* last, T* dest)
+{
+   return detail::uninitialized_relocate_impl(first, last, dest,
+      std::integral_constant<bool, is_trivially_relocatable<T>::value>());
+}
+
+template<class T>
+class relocating_vector
+{
+   typedef std::integral_constant<bool, is_trivially_relocatable<T>::value> relocatable;
+
+public:
+   typedef T value_type;
+   typedef size_t size_type;
+   typedef T& reference;
+   typedef const T& const_reference;
+   typedef T* iterator;
+   typedef const T* const_iterator;
+
+   relocating_vector() : m_begin(nullptr), m_end(nullptr), m_capacity(nullptr) {}
+
+   relocating_vector(const relocating_vector& other) :
+      m_begin(nullptr), m_end(nullptr), m_capacity(nullptr)
+   {
+      reserve(other.size());
+      try
+      {
+         for (const T& item : other)
+         {
+            ::new (static_cast<void*>(m_end)) T(item);
+            ++m_end;
+         }
+      }
+      catch (...)
+      {
+         // The destructor won't run for a constructor that throws.
+         clear();
+         deallocate(m_begin, capacity());
+         throw;
+      }
+   }
+
+   relocating_vector(relocating_vector&& other) :
+      m_begin(other.m_begin), m_end(other.m_end), m_capacity(other.m_capacity)
+   {
+      other.m_begin = other.m_end = other.m_capacity = nullptr;
+   }
+
+   relocating_vector& operator=(relocating_vector other)
+   {
+      swap(other);
+      return *this;
+   }
+
+   ~relocating_vector()
+   {
+      clear();
+      deallocate(m_begin, capacity());
+   }
+
+   void swap(relocating_vector& other)
+   {
+      std::swap(m_begin, other.m_begin);
+      std::swap(m_end, other.m_end);
+      std::swap(m_capacity, other.m_capacity);
+   }
+
+   iterator begin() { return m_begin; }
+   iterator end() { return m_end; }
+   const_iterator begin() const { return m_begin; }
+   const_iterator end() const { return m_end; }
+
+   size_type size() const { return static_cast<size_type>(m_end - m_begin); }
+   size_type capacity() const { return static_cast<size_type>(m_capacity - m_begin); }
+   bool empty() const { return m_begin == m_end; }
+
+   T* data() { return m_begin; }
+   const T* data() const { return m_begin; }
+
+   reference operator[](size_type i) { assert(i < size()); return m_begin[i]; }
+   const_reference operator[](size_type i) const { assert(i < size()); return m_begin[i]; }
+
+   reference front() { assert(!empty()); return *m_begin; }
+   const_reference front() const { assert(!empty()); return *m_begin; }
+   reference back() { assert(!empty()); return *(m_end - 1); }
+   const_reference back() const { assert(!empty()); return *(m_end - 1); }
+
+   void reserve(size_type new_capacity)
+   {
+      if (new_capacity <= capacity())
+         return;
+
+      T* new_begin = allocate(new_capacity);
+      T* new_end;
+      try
+      {
+         new_end = detail::uninitialized_relocate_impl(m_begin, m_end, new_begin, relocatable());
+      }
+      catch (...)
+      {
+         deallocate(new_begin, new_capacity);
+         throw;
+      }
+      deallocate(m_begin, capacity());
+
+      m_begin = new_begin;
+      m_end = new_end;
+      m_capacity = new_begin + new_capacity;
+   }
+
+   void push_back(const T& value) { emplace_back(value); }
+   void push_back(T&& value) { emplace_back(std::move(value)); }
+
+   template<class ... Args>
+   reference emplace_back(Args&&... args)
+   {
+      if (m_end == m_capacity)
+      {
+         // Construct into the new buffer before relocating the old elements,
+         // in case args refers to one of them.
+         const size_type old_size = size();
+         const size_type new_capacity = grow_capacity(old_size + 1);
+         T* new_begin = allocate(new_capacity);
+         try
+         {
+            ::new (static_cast<void*>(new_begin + old_size)) T(std::forward<Args>(args)...);
+         }
+         catch (...)
+         {
+            deallocate(new_begin, new_capacity);
+            throw;
+         }
+         try
+         {
+            detail::uninitialized_relocate_impl(m_begin, m_end, new_begin, relocatable());
+         }
+         catch (...)
+         {
+            (new_begin + old_size)->~T();
+            deallocate(new_begin, new_capacity);
+            throw;
+         }
+         deallocate(m_begin, capacity());
+
+         m_begin = new_begin;
+         m_end = new_begin + old_size + 1;
+         m_capacity = new_begin + new_capacity;
+      }
+      else
+      {
+         ::new (static_cast<void*>(m_end)) T(std::forward<Args>(args)...);
+         ++m_end;
+      }
+      return back();
+   }
+
+   void pop_back()
+   {
+      assert(!empty());
+      (--m_end)->~T();
+   }
+
+   iterator erase(const_iterator pos)
+   {
+      return erase(pos, pos + 1);
+   }
+
+   // Destroys [first, last) and moves the tail down over the gap.
+   iterator erase(const_iterator first, const_iterator last)
+   {
+      assert(m_begin <= first && first <= last && last <= m_end);
+      T* dest = m_begin + (first - m_begin);
+      T* src = m_begin + (last - m_begin);
+      if (dest == src)
+         return dest;
+
+      m_end = detail::erase_range(dest, src, m_end, relocatable());
+      return dest;
+   }
+
+   void clear()
+   {
+      while (m_end != m_begin)
+         (--m_end)->~T();
+   }
+
+private:
+   size_type grow_capacity(size_type needed) const
+   {
+      const size_type doubled = capacity() * 2;
+      return doubled > needed ? doubled : (needed < 4 ? 4 : needed);
+   }
+
+   static T* allocate(size_type n)
+   {
+      return std::allocator<T>().allocate(n);
+   }
+
+   static void deallocate(T* p, size_type n)
+   {
+      if (p)
+         std::allocator<T>().deallocate(p, n);
+   }
+
+   T* m_begin;
+   T* m_end;
+   T* m_capacity;
+};
+
+} // namespace cppbits
@@ -0,0 +1,277 @@
+// Compile-time evaluation of cppbits::format for constant arguments.
+//
+// Requires C++20 (class types as non-type template parameters, consteval).
+//
+// Strings like version banners, metric names, and route tables are often
+// built only from constants, but going through cppbits::format still means
+// a std::stringstream and a heap allocation at startup. static_format takes
+// the format string and the arguments as template parameters and does all of
+// the work at compile time; the result is a fixed_string living in static
+// storage.
+//
+// The format item syntax is the same as format.h:
+// {index[,alignment][:specifier[precision]]
+//
+// Supported arguments are integers, bool, char, enums (printed as their
+// underlying type, so enums based on char types print as characters, just
+// like with std::ostream), and fixed_string. The specifiers that matter for
+// those types are honoured the same way std::ostream would:
+//    d/D -> decimal
+//    o/O -> octal
+//    x/X -> hexadecimal (lowercase/uppercase)
+// e/E, f/F and precision have no effect on integers, so they are accepted and
+// ignored. As with format.h, an index with no matching argument prints nothing.
+// A '{' without a closing '}' is a compile error.
+//
+// USAGE:
+//
+//    constexpr auto& banner = cppbits::static_format<"myapp v{0}.{1}.{2}", 2, 4, 1>();
+//    puts(banner.c_str());
+//
+//    constexpr auto& route = cppbits::static_format<"/api/{0}/{1:x}",
+//       cppbits::fixed_string("users"), 0xbeef>();
+//
+// ===============================================================================
+// This file is released into the public domain. See LICENCE for more information.
+// ===============================================================================
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace cppbits {
+
+// A string whose contents are part of its type, usable as a template parameter.
+// N includes the terminating NUL.
+template<size_t N>
+struct fixed_string
+{
+	constexpr fixed_string() {}
+
+	constexpr fixed_string(const char (&str)[N])
+	{
+		for (size_t i = 0; i < N; ++i)
+			m_data[i] = str[i];
+	}
+
+	constexpr size_t size() const { return N - 1; }
+	constexpr const char* c_str() const { return m_data; }
+	constexpr const char* data() const { return m_data; }
+	constexpr const char* begin() const { return m_data; }
+	constexpr const char* end() const { return m_data + N - 1; }
+	constexpr char operator[](size_t i) const { return m_data[i]; }
+
+	constexpr operator std::string_view() const { return std::string_view(m_data, N - 1); }
+	operator std::string() const { return std::string(m_data, N - 1); }
+
+	// Public so that fixed_string is a structural type.
+	char m_data[N] = {};
+};
+
+namespace detail {
+
+template<class T>
+struct is_fixed_string : std::false_type {};
+
+template<size_t N>
+struct is_fixed_string<fixed_string<N>> : std::true_type {};
+
+// Output sink for the first pass: only counts characters.
+struct static_format_counter
+{
+	constexpr void put(char) { ++length; }
+	size_t length = 0;
+};
+
+// Output sink for the second pass: writes into the result.
+template<size_t N>
+struct static_format_writer
+{
+	constexpr void put(char c) { result.m_data[length++] = c; }
+	fixed_string<N> result;
+	size_t length = 0;
+};
+
+template<class Out, class T>
+constexpr void static_print_unsigned(Out& out, T value, unsigned base, bool upper, size_t width)
+{
+	const char* digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+	char buf[sizeof(T) * 8 + 1] = {};
+	size_t n = 0;
+	do
+	{
+		buf[n++] = digits[value % base];
+		value /= base;
+	} while (value != 0);
+
+	for (size_t i = n; i < width; ++i)
+		out.put(' ');
+	while (n > 0)
+		out.put(buf[--n]);
+}
+
+// Mirrors what operator<< plus the manipulators from default_format_handler
+// would produce for a single argument.
+template<class Out, auto Arg>
+constexpr void static_print(Out& out, size_t width, char specifier)
+{
+	using T = std::remove_cv_t<decltype(Arg)>;
+
+	if constexpr (is_fixed_string<T>::value)
+	{
+		for (size_t i = Arg.size(); i < width; ++i)
+			out.put(' ');
+		for (char c : Arg)
+			out.put(c);
+	}
+	else if constexpr (std::is_same_v<T, char> || std::is_same_v<T, signed char> || std::is_same_v<T, unsigned char>)
+	{
+		for (size_t i = 1; i < width; ++i)
+			out.put(' ');
+		out.put(static_cast<char>(Arg));
+	}
+	else if constexpr (std::is_enum_v<T>)
+	{
+		// Streaming an unscoped enum with a fixed underlying type picks the
+		// operator<< for that type, so one based on char prints a character.
+		static_print<Out, static_cast<std::underlying_type_t<T>>(Arg)>(out, width, specifier);
+	}
+	else if constexpr (std::is_integral_v<T>)
+	{
+		using U = std::make_unsigned_t<std::conditional_t<std::is_same_v<T, bool>, int, T>>;
+		const char lower = (specifier >= 'A' && specifier <= 'Z') ? specifier - 'A' + 'a' : specifier;
+		const bool upper = (specifier >= 'A' && specifier <= 'Z');
+
+		if (lower == 'x' || lower == 'o')
+		{
+			// Like std::ostream, non-decimal bases print the two's complement bits.
+			static_print_unsigned(out, static_cast<U>(Arg), lower == 'x' ? 16 : 8, upper, width);
+		}
+		else if constexpr (std::is_signed_v<T>)
+		{
+			if (Arg < 0)
+			{
+				// Count the digits so the '-' lands after the padding.
+				static_format_counter digits;
+				static_print_unsigned(digits, static_cast<U>(U(0) - static_cast<U>(Arg)), 10, false, 0);
+				for (size_t i = digits.length + 1; i < width; ++i)
+					out.put(' ');
+				out.put('-');
+				static_print_unsigned(out, static_cast<U>(U(0) - static_cast<U>(Arg)), 10, false, 0);
+			}
+			else
+			{
+				static_print_unsigned(out, static_cast<U>(Arg), 10, false, width);
+			}
+		}
+		else
+		{
+			static_print_unsigned(out, static_cast<U>(Arg), 10, false, width);
+		}
+	}
+	else
+	{
+		static_assert(is_fixed_string<T>::value || std::is_integral_v<T>,
+			"static_format only supports integral, enum, and fixed_string arguments");
+	}
+}
+
+template<class Out, auto First, auto ... Rest>
+constexpr void static_print_argument(Out& out, size_t index, size_t width, char specifier)
+{
+	if (index == 0)
+		static_print<Out, First>(out, width, specifier);
+	else if constexpr (sizeof...(Rest) > 0)
+		static_print_argument<Out, Rest...>(out, index - 1, width, specifier);
+}
+
+// Same parsing rules as parse_format_item_helper in format.h.
+template<class Out, fixed_string Fmt, auto ... Args>
+constexpr void static_render(Out& out)
+{
+	size_t i = 0;
+	while (i < Fmt.size())
+	{
+		if (Fmt[i] != '{')
+		{
+			out.put(Fmt[i++]);
+			continue;
+		}
+
+		size_t argument = 0;
+		size_t width = 0;
+		char specifier = 'G';
+		enum { kArgumentPosition, kWidth, kSpecifier, kPrecision } state = kArgumentPosition;
+
+		for (++i; Fmt[i] != '}'; ++i)
+		{
+			if (i >= Fmt.size())
+				throw "static_format: unterminated format item";
+
+			const char c = Fmt[i];
+			if (c >= '0' && c <= '9')
+			{
+				if (state == kArgumentPosition)
+					argument = (argument * 10) + (c - '0');
+				else if (state == kWidth)
+					width = (width * 10) + (c - '0');
+			}
+			else if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'))
+			{
+				if (state == kSpecifier)
+				{
+					specifier = c;
+					state = kPrecision;
+				}
+			}
+			else if (c == ':')
+			{
+				state = kSpecifier;
+			}
+			else if (c == ',')
+			{
+				state = kWidth;
+			}
+		}
+		++i;
+
+		if constexpr (sizeof...(Args) > 0)
+		{
+			if (argument < sizeof...(Args))
+				static_print_argument<Out, Args...>(out, argument, width, specifier);
+		}
+	}
+}
+
+template<fixed_string Fmt, auto ... Args>
+consteval size_t static_format_length()
+{
+	static_format_counter counter;
+	static_render<static_format_counter, Fmt, Args...>(counter);
+	return counter.length;
+}
+
+template<fixed_string Fmt, auto ... Args>
+consteval auto static_format_eval()
+{
+	static_format_writer<static_format_length<Fmt, Args...>() + 1> writer;
+	static_render<decltype(writer), Fmt, Args...>(writer);
+	return writer.result;
+}
+
+template<fixed_string Fmt, auto ... Args>
+inline constexpr auto static_format_value = static_format_eval<Fmt, Args...>();
+
+} // namespace detail
+
+// Returns a reference to the formatted string, which lives in static storage.
+template<fixed_string Fmt, auto ... Args>
+constexpr const auto& static_format()
+{
+	return detail::static_format_value<Fmt, Args...>;
+}
+
+} // namespace cppbits
@@ -0,0 +1,310 @@
+// A chunked string builder for assembling output from many pieces.
+//
+// Building a big response with std::string::operator+= copies everything
+// seen so far every time the string has to grow, and every cppbits::format
+// result is its own temporary std::string on top of that. string_builder
+// appends into a list of fixed-size chunks instead: nothing already written
+// ever moves, and format_append renders straight into the chunks. When
+// you're done, either copy it out into one std::string, or hand the chunks
+// to writev() as they are.
+//
+// To use:
+//
+//    cppbits::string_builder out;
+//    out.append("HTTP/1.1 200 OK\r\n");
+//    for (auto& h : headers)
+//       out.format_append("{0}: {1}\r\n", h.name, h.value);
+//    out.append("\r\n");
+//
+//    std::string response = out.str();
+//
+//    // or, on POSIX, without the copy:
+//    std::vector<iovec> iov;
+//    out.to_iovec(iov);
+//    writev(fd, iov.data(), static_cast<int>(iov.size()));
+//
+// writev() takes at most IOV_MAX (usually 1024) iovecs, which is 4 MiB at the
+// default chunk size, and may write less than it was given. For output that
+// could be bigger, or a descriptor that could take a partial write, use the
+// overload that starts at a byte offset and caps the count:
+//
+//    size_t sent = 0;
+//    while (sent < out.size())
+//    {
+//       out.to_iovec(iov, sent, IOV_MAX);
+//       const ssize_t n = writev(fd, iov.data(), static_cast<int>(iov.size()));
+//       if (n < 0)
+//          break; // (or handle EINTR/EAGAIN)
+//       sent += static_cast<size_t>(n);
+//    }
+//
+// clear() keeps the chunks around, so a builder that gets reused (say, one per
+// connection) stops allocating once it has reached its working size.
+//
+// ===============================================================================
+// This file is released into the public domain. See LICENCE for more information.
+// ===============================================================================
+
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if !defined(_WIN32)
+	#include <sys/uio.h>
+#endif
+
+#include "format.h"
+
+namespace cppbits {
+
+class string_builder
+{
+public:
+	static const size_t kDefaultChunkSize = 4096;
+
+	explicit string_builder(size_t chunk_size = kDefaultChunkSize) :
+		m_chunk_size(chunk_size ? chunk_size : size_t(kDefaultChunkSize)),
+		m_current(0),
+		m_size(0)
+	{}
+
+	string_builder(string_builder&& other) :
+		m_chunks(std::move(other.m_chunks)),
+		m_chunk_size(other.m_chunk_size),
+		m_current(other.m_current),
+		m_size(other.m_size)
+	{
+		other.m_current = 0;
+		other.m_size = 0;
+	}
+
+	string_builder& operator=(string_builder&& other)
+	{
+		m_chunks = std::move(other.m_chunks);
+		m_chunk_size = other.m_chunk_size;
+		m_current = other.m_current;
+		m_size = other.m_size;
+		other.m_current = 0;
+		other.m_size = 0;
+		return *this;
+	}
+
+	string_builder(const string_builder&) = delete;
+	string_builder& operator=(const string_builder&) = delete;
+
+	string_builder& append(const char* data, size_t length)
+	{
+		while (length)
+		{
+			size_t available;
+			char* p = free_space(available);
+			const size_t n = length < available ? length : available;
+			std::memcpy(p, data, n);
+			commit(n);
+			data += n;
+			length -= n;
+		}
+		return *this;
+	}
+
+	string_builder& append(const char* str)
+	{
+		return append(str, std::strlen(str));
+	}
+
+	string_builder& append(const std::string& str)
+	{
+		return append(str.data(), str.size());
+	}
+
+	string_builder& append(char c)
+	{
+		size_t available;
+		*free_space(available) = c;
+		commit(1);
+		return *this;
+	}
+
+	// Appends cppbits::format(str, args...), rendering directly into the chunks.
+	template<class ... T>
+	string_builder& format_append(const std::string& str, T... args)
+	{
+		builder_streambuf buf(*this);
+		std::ostream o(&buf);
+		o << format(str, std::forward<T>(args)...);
+		buf.finish();
+		return *this;
+	}
+
+	size_t size() const { return m_size; }
+	bool empty() const { return m_size == 0; }
+
+	// Copies everything into one string.
+	std::string str() const
+	{
+		std::string result;
+		result.reserve(m_size);
+		for_each_chunk([&result](const char* data, size_t length) {
+			result.append(data, length);
+		});
+		return result;
+	}
+
+	void write_to(std::ostream& o) const
+	{
+		for_each_chunk([&o](const char* data, size_t length) {
+			o.write(data, static_cast<std::streamsize>(length));
+		});
+	}
+
+	// Calls fn(const char* data, size_t length) for each non-empty chunk, in order.
+	template<class Fn>
+	void for_each_chunk(Fn fn) const
+	{
+		for (size_t i = 0; i < m_chunks.size() && i <= m_current; ++i)
+		{
+			if (m_chunks[i].used)
+				fn(m_chunks[i].data.get(), m_chunks[i].used);
+		}
+	}
+
+#if !defined(_WIN32)
+	// Replaces the contents of out with one iovec per non-empty chunk. They
+	// point into the builder, so don't modify it until the write is done.
+	void to_iovec(std::vector<iovec>& out) const
+	{
+		out.clear();
+		for_each_chunk([&out](const char* data, size_t length) {
+			iovec v;
+			v.iov_base = const_cast<char*>(data);
+			v.iov_len = length;
+			out.push_back(v);
+		});
+	}
+
+	// Same, but starting offset bytes in and with at most max_count iovecs,
+	// for resuming after a partial write and staying under IOV_MAX. Returns
+	// the number of bytes the iovecs cover.
+	size_t to_iovec(std::vector<iovec>& out, size_t offset, size_t max_count) const
+	{
+		out.clear();
+		size_t covered = 0;
+		for (size_t i = 0; i < m_chunks.size() && i <= m_current && out.size() < max_count; ++i)
+		{
+			const size_t used = m_chunks[i].used;
+			if (offset >= used)
+			{
+				offset -= used;
+				continue;
+			}
+
+			iovec v;
+			v.iov_base = m_chunks[i].data.get() + offset;
+			v.iov_len = used - offset;
+			out.push_back(v);
+			covered += v.iov_len;
+			offset = 0;
+		}
+		return covered;
+	}
+#endif
+
+	// Empties the builder, keeping its chunks for reuse.
+	void clear()
+	{
+		for (chunk& c : m_chunks)
+			c.used = 0;
+		m_current = 0;
+		m_size = 0;
+	}
+
+private:
+	struct chunk
+	{
+		std::unique_ptr<char[]> data;
+		size_t used;
+	};
+
+	// Writes into the free space of the current chunk, moving on to the next
+	// one when it fills up.
+	class builder_streambuf : public std::streambuf
+	{
+	public:
+		explicit builder_streambuf(string_builder& builder) : m_builder(builder)
+		{
+			reset();
+		}
+
+		void finish()
+		{
+			m_builder.commit(static_cast<size_t>(pptr() - pbase()));
+			setp(nullptr, nullptr);
+		}
+
+	protected:
+		virtual int_type overflow(int_type ch)
+		{
+			finish();
+			reset();
+			if (!traits_type::eq_int_type(ch, traits_type::eof()))
+				sputc(traits_type::to_char_type(ch));
+			return traits_type::not_eof(ch);
+		}
+
+	private:
+		void reset()
+		{
+			size_t available;
+			char* p = m_builder.free_space(available);
+			setp(p, p + available);
+		}
+
+		string_builder& m_builder;
+	};
+
+	// Returns the free space at the end of the current chunk, starting a new
+	// chunk if it's full. available is always at least 1.
+	char* free_space(size_t& available)
+	{
+		if (m_chunks.empty())
+			add_chunk();
+		else if (m_chunks[m_current].used == m_chunk_size)
+		{
+			++m_current;
+			if (m_current == m_chunks.size())
+				add_chunk();
+		}
+
+		chunk& c = m_chunks[m_current];
+		available = m_chunk_size - c.used;
+		return c.data.get() + c.used;
+	}
+
+	void commit(size_t length)
+	{
+		m_chunks[m_current].used += length;
+		m_size += length;
+	}
+
+	void add_chunk()
+	{
+		chunk c;
+		c.data.reset(new char[m_chunk_size]);
+		c.used = 0;
+		m_chunks.push_back(std::move(c));
+	}
+
+	std::vector<chunk> m_chunks;
+	size_t m_chunk_size;
+	size_t m_current;
+	size_t m_size;
+};
+
+} // namespace cppbits
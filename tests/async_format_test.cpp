@@ -0,0 +1,146 @@
+#include <cassert>
+#include <coroutine>
+#include <exception>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "async_format.h"
+
+namespace {
+
+// Starts running immediately and stays suspended at the end, so the test can
+// check whether it finished.
+struct task
+{
+	struct promise_type
+	{
+		task get_return_object() { return task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+		std::suspend_never initial_suspend() noexcept { return {}; }
+		std::suspend_always final_suspend() noexcept { return {}; }
+		void return_void() {}
+		void unhandled_exception() { std::terminate(); }
+	};
+
+	explicit task(std::coroutine_handle<promise_type> h) : handle(h) {}
+	task(const task&) = delete;
+	task& operator=(const task&) = delete;
+	~task()
+	{
+		if (handle)
+			handle.destroy();
+	}
+
+	bool done() const { return handle.done(); }
+
+	void destroy()
+	{
+		handle.destroy();
+		handle = nullptr;
+	}
+
+	std::coroutine_handle<promise_type> handle;
+};
+
+task write_twice(cppbits::fd_sink& out, const std::string& payload, size_t& written)
+{
+	written = co_await cppbits::async_format_to(out, "[{0}]", payload);
+	written += co_await cppbits::async_format_to(out, "{0} bytes\n", payload.size());
+}
+
+void make_socket_pair(int fds[2])
+{
+	const int r = ::socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+	assert(r == 0);
+	(void)r;
+	::fcntl(fds[0], F_SETFL, ::fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+}
+
+std::string read_all(int fd)
+{
+	std::string result;
+	char buffer[16 * 1024];
+	ssize_t n;
+	while ((n = ::read(fd, buffer, sizeof(buffer))) > 0)
+		result.append(buffer, static_cast<size_t>(n));
+	return result;
+}
+
+// Reads whatever is already there, without waiting for more.
+void drain(int fd)
+{
+	char buffer[16 * 1024];
+	while (::recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT) > 0)
+	{
+	}
+}
+
+// Big enough not to fit in the socket buffer, so the write has to suspend.
+const std::string payload(4 * 1024 * 1024, 'x');
+
+void suspend_and_resume_test()
+{
+	int fds[2];
+	make_socket_pair(fds);
+
+	cppbits::event_loop loop;
+	cppbits::fd_sink out(loop, fds[0]);
+
+	size_t written = 0;
+	task t = write_twice(out, payload, written);
+	assert(!t.done());
+	assert(loop.has_waiters());
+
+	std::string received;
+	std::thread reader([&] { received = read_all(fds[1]); });
+	loop.run();
+	assert(t.done());
+
+	loop.forget(fds[0]);
+	::close(fds[0]);
+	reader.join();
+	::close(fds[1]);
+
+	const std::string expected = "[" + payload + "]" + std::to_string(payload.size()) + " bytes\n";
+	assert(written == expected.size());
+	assert(received == expected);
+}
+
+void destroy_while_suspended_test()
+{
+	int fds[2];
+	make_socket_pair(fds);
+
+	cppbits::event_loop loop;
+	cppbits::fd_sink out(loop, fds[0]);
+
+	size_t written = 0;
+	task t = write_twice(out, payload, written);
+	assert(!t.done());
+	assert(loop.has_waiters());
+
+	// Destroying the coroutine destroys the pending write with it, which has
+	// to take its callback back out of the loop.
+	t.destroy();
+	assert(!loop.has_waiters());
+
+	// Make the descriptor writable again; nothing should get called.
+	drain(fds[1]);
+	assert(loop.run_once(0) == 0);
+
+	loop.forget(fds[0]);
+	::close(fds[0]);
+	::close(fds[1]);
+}
+
+} // namespace
+
+int main()
+{
+	suspend_and_resume_test();
+	destroy_while_suspended_test();
+	return 0;
+}
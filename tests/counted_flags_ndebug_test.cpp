@@ -0,0 +1,43 @@
+// Checks what counted_flags does with too many acquires when its asserts are
+// compiled out: the count has to saturate, not wrap around to zero.
+
+#undef NDEBUG
+#define NDEBUG
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+#include "counted_flags.h"
+#include "enum_flags.h"
+
+enum interest : uint32_t
+{
+	kInterestNone = 0,
+	kInterestRead = 1 << 0
+};
+
+namespace cppbits {
+template<>
+struct is_enum_flags<interest> : std::true_type{};
+}
+
+#define CHECK(x) \
+	do { if (!(x)) { std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #x); std::abort(); } } while (0)
+
+int main()
+{
+	cppbits::counted_flags<interest, uint8_t> flags;
+	for (int i = 0; i < 300; ++i)
+		CHECK(flags.acquire(kInterestRead) == (i == 0 ? kInterestRead : kInterestNone));
+	CHECK(flags.count(kInterestRead) == 255);
+	CHECK(flags.value() == kInterestRead);
+
+	// The acquires past 255 were dropped, so 255 releases clear the bit.
+	for (int i = 0; i < 254; ++i)
+		CHECK(flags.release(kInterestRead) == kInterestNone);
+	CHECK(flags.release(kInterestRead) == kInterestRead);
+	CHECK(flags.release(kInterestRead) == kInterestNone);
+	CHECK(flags.value() == kInterestNone);
+	return 0;
+}
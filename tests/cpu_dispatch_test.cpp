@@ -0,0 +1,186 @@
+// Checks every flag_router matching kernel the CPU supports against a plain
+// loop. CMake also runs this once per CPPBITS_CPU_LEVEL value, so the
+// environment cap and the kernel flag_router picks under it get covered too.
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "cpu_features.h"
+#include "enum_flags.h"
+#include "flag_router.h"
+
+enum test_topic : uint64_t
+{
+	kTopicNone = 0,
+	kTopicHigh = uint64_t(1) << 63
+};
+
+namespace cppbits {
+template<>
+struct is_enum_flags<test_topic> : std::true_type{};
+}
+
+static std::vector<uint32_t> expected_matches(const std::vector<uint64_t>& masks, uint64_t topic)
+{
+	std::vector<uint32_t> out;
+	for (size_t i = 0; i < masks.size(); ++i)
+	{
+		if (masks[i] & topic)
+			out.push_back(static_cast<uint32_t>(i));
+	}
+	return out;
+}
+
+static void check_kernel(cppbits::detail::flag_match_fn fn, std::mt19937_64& rng)
+{
+	// Sizes around the 4- and 8-wide vector loops, so the scalar tails get hit.
+	for (size_t n = 0; n < 40; ++n)
+	{
+		std::vector<uint64_t> masks(n);
+		std::vector<uint32_t> ids(n);
+		for (size_t i = 0; i < n; ++i)
+		{
+			// Sparse masks, so roughly half of them match.
+			masks[i] = rng() & rng() & rng();
+			ids[i] = static_cast<uint32_t>(i);
+		}
+
+		for (int t = 0; t < 8; ++t)
+		{
+			const uint64_t topic = rng();
+			std::vector<uint32_t> out(n + 1, 0xFFFFFFFFu);
+			const size_t count = fn(masks.data(), ids.data(), n, topic, out.data());
+			out.resize(count);
+			assert(out == expected_matches(masks, topic));
+		}
+	}
+}
+
+static void check_router(std::mt19937_64& rng)
+{
+	cppbits::flag_router<test_topic> router;
+	std::vector<uint64_t> masks;
+	for (int i = 0; i < 1000; ++i)
+	{
+		masks.push_back(rng() & rng() & rng());
+		router.subscribe(static_cast<test_topic>(masks.back()));
+	}
+
+	std::vector<uint32_t> matched;
+	for (int t = 0; t < 64; ++t)
+	{
+		const uint64_t topic = rng();
+		router.match(static_cast<test_topic>(topic), matched);
+		std::sort(matched.begin(), matched.end());
+		assert(matched == expected_matches(masks, topic));
+	}
+}
+
+// Random subscribes, unsubscribes, and updates against a plain model indexed
+// by ID, so the swap-with-last in unsubscribe and ID reuse get exercised.
+static void check_router_churn(std::mt19937_64& rng)
+{
+	cppbits::flag_router<test_topic> router;
+	std::vector<uint64_t> masks;   // indexed by id
+	std::vector<bool> live;        // indexed by id
+	std::vector<uint32_t> free_ids;
+	std::vector<uint32_t> live_ids;
+	std::vector<uint32_t> matched;
+
+	for (int step = 0; step < 4000; ++step)
+	{
+		const unsigned op = static_cast<unsigned>(rng() % 8);
+		if (op < 3 || live_ids.empty())
+		{
+			const uint64_t mask = rng() & rng() & rng();
+			const uint32_t id = router.subscribe(static_cast<test_topic>(mask));
+			if (!free_ids.empty())
+			{
+				// The most recently freed ID comes back first.
+				assert(id == free_ids.back());
+				free_ids.pop_back();
+			}
+			else
+			{
+				assert(id == masks.size());
+				masks.push_back(0);
+				live.push_back(false);
+			}
+			assert(!live[id]);
+			masks[id] = mask;
+			live[id] = true;
+			live_ids.push_back(id);
+		}
+		else if (op < 5)
+		{
+			const size_t pick = static_cast<size_t>(rng() % live_ids.size());
+			const uint32_t id = live_ids[pick];
+			router.unsubscribe(id);
+			live[id] = false;
+			free_ids.push_back(id);
+			live_ids[pick] = live_ids.back();
+			live_ids.pop_back();
+			assert(!router.is_subscribed(id));
+		}
+		else if (op < 7)
+		{
+			const uint32_t id = live_ids[static_cast<size_t>(rng() % live_ids.size())];
+			masks[id] = rng() & rng() & rng();
+			router.update(id, static_cast<test_topic>(masks[id]));
+		}
+		else
+		{
+			const uint64_t topic = rng();
+			router.match(static_cast<test_topic>(topic), matched);
+			std::sort(matched.begin(), matched.end());
+
+			std::vector<uint32_t> expected;
+			for (size_t id = 0; id < masks.size(); ++id)
+			{
+				if (live[id] && (masks[id] & topic))
+					expected.push_back(static_cast<uint32_t>(id));
+			}
+			assert(matched == expected);
+		}
+
+		assert(router.size() == live_ids.size());
+	}
+
+	for (size_t id = 0; id < masks.size(); ++id)
+	{
+		assert(router.is_subscribed(static_cast<uint32_t>(id)) == live[id]);
+		if (live[id])
+			assert(static_cast<uint64_t>(router.interest(static_cast<uint32_t>(id))) == masks[id]);
+	}
+	assert(!router.is_subscribed(static_cast<uint32_t>(masks.size())));
+}
+
+int main()
+{
+	using namespace cppbits;
+
+	std::mt19937_64 rng(12345);
+	const cpu_level supported = detail::level_from_features(cpu_features());
+
+#if defined(CPPBITS_CPU_X86)
+	const kernel_variants<detail::flag_match_fn> kernels(detail::flag_match_scalar, nullptr,
+		detail::flag_match_avx2, detail::flag_match_avx512);
+#else
+	const kernel_variants<detail::flag_match_fn> kernels(detail::flag_match_scalar);
+#endif
+
+	for (int level = kCpuLevelScalar; level <= supported; ++level)
+		check_kernel(select_kernel(kernels, static_cast<cpu_level>(level)), rng);
+
+	assert(current_cpu_level() <= supported);
+	assert(current_cpu_level() <= detail::level_from_environment());
+	check_router(rng);
+	check_router_churn(rng);
+
+	std::printf("cpu level: supported %d, in use %d\n", int(supported), int(current_cpu_level()));
+	return 0;
+}
@@ -0,0 +1,80 @@
+#include <cassert>
+#include <cstdint>
+
+#include "bits.h"
+#include "counted_flags.h"
+#include "enum_flags.h"
+#include "flat_flags_map.h"
+
+enum interest : uint64_t
+{
+	kInterestNone = 0,
+	kInterestRead = 1 << 0,
+	kInterestWrite = 1 << 1,
+	kInterestHigh = uint64_t(1) << 63
+};
+
+namespace cppbits {
+template<>
+struct is_enum_flags<interest> : std::true_type{};
+}
+
+static void lowest_set_bit_tests()
+{
+	for (unsigned i = 0; i < 64; ++i)
+	{
+		assert(cppbits::detail::lowest_set_bit(uint64_t(1) << i) == i);
+		assert(cppbits::detail::lowest_set_bit(~uint64_t(0) << i) == i);
+	}
+	// 32-bit masks, as flat_flags_map passes them.
+	assert(cppbits::detail::lowest_set_bit(uint32_t(0x80000000u)) == 31);
+	assert(cppbits::detail::lowest_set_bit(uint32_t(0x00010100u)) == 8);
+}
+
+static void counted_flags_tests()
+{
+	cppbits::counted_flags<interest> flags;
+	assert(flags.acquire(kInterestRead | kInterestWrite) == (kInterestRead | kInterestWrite));
+	assert(flags.acquire(kInterestWrite | kInterestHigh) == kInterestHigh);
+	assert(flags.release(kInterestRead | kInterestWrite) == kInterestRead);
+	assert(flags.value() == (kInterestWrite | kInterestHigh));
+	assert(flags.count(kInterestWrite) == 1);
+	assert(flags.count(kInterestHigh) == 1);
+
+	// A uint8_t counter holds exactly 255 references.
+	cppbits::counted_flags<interest, uint8_t> small;
+	for (int i = 0; i < 255; ++i)
+		assert(small.acquire(kInterestRead) == (i == 0 ? kInterestRead : kInterestNone));
+	assert(small.count(kInterestRead) == 255);
+	for (int i = 0; i < 254; ++i)
+		assert(small.release(kInterestRead) == kInterestNone);
+	assert(small.release(kInterestRead) == kInterestRead);
+	assert(small.value() == kInterestNone);
+}
+
+static void flat_flags_map_tests()
+{
+	cppbits::flat_flags_map<uint32_t, uint32_t> map;
+	for (uint32_t i = 0; i < 1000; ++i)
+		map.try_emplace(i * 7, i);
+	assert(map.size() == 1000);
+	for (uint32_t i = 0; i < 1000; ++i)
+	{
+		auto itr = map.find(i * 7);
+		assert(itr != map.end() && itr->second == i);
+	}
+	assert(map.find(3) == map.end());
+
+	for (uint32_t i = 0; i < 1000; i += 2)
+		assert(map.erase(i * 7) == 1);
+	assert(map.size() == 500);
+	assert(map.count(14) == 0 && map.count(7) == 1);
+}
+
+int main()
+{
+	lowest_set_bit_tests();
+	counted_flags_tests();
+	flat_flags_map_tests();
+	return 0;
+}
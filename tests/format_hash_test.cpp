@@ -0,0 +1,13 @@
+#include <cassert>
+#include <string>
+
+#include "format.h"
+#include "format_hash.h"
+
+void format_hash_tests()
+{
+	const std::string expected = cppbits::format("user:{0}:{1}", 42, "abc");
+	assert(cppbits::format_hash("user:{0}:{1}", 42, "abc")
+		== cppbits::hash_string(expected.data(), expected.size()));
+	assert(cppbits::format_hash("user:{0}", 1) != cppbits::format_hash("user:{0}", 2));
+}
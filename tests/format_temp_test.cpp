@@ -0,0 +1,119 @@
+#include <cassert>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "format_temp.h"
+
+namespace {
+
+bool is_terminated(std::string_view s)
+{
+	return s.data()[s.size()] == '\0';
+}
+
+void basic_tests()
+{
+	cppbits::temp_scope scope;
+	const std::string_view a = cppbits::format_temp("{0}/{1}.log", "/var/log", 42);
+	const std::string_view b = cppbits::format_temp("{0}", "");
+	assert(a == "/var/log/42.log" && is_terminated(a));
+	assert(b.empty() && is_terminated(b));
+	assert(std::strlen(a.data()) == a.size());
+}
+
+void nested_scope_tests()
+{
+	cppbits::temp_scope outer;
+	const std::string_view a = cppbits::format_temp("outer {0}", 1);
+
+	const char* inner_address;
+	{
+		cppbits::temp_scope inner;
+		const std::string_view b = cppbits::format_temp("inner {0}", 2);
+		assert(b == "inner 2" && is_terminated(b));
+		inner_address = b.data();
+
+		{
+			cppbits::temp_scope innermost;
+			const std::string_view c = cppbits::format_temp("innermost {0}", 3);
+			assert(c == "innermost 3");
+		}
+
+		// Popping innermost leaves what inner and outer allocated alone.
+		assert(a == "outer 1" && b == "inner 2");
+
+#if !defined(NDEBUG) && !defined(__SANITIZE_ADDRESS__)
+		// Released memory is filled, so stale reads are obvious.
+		const std::string_view stale(b.data() + b.size() + 1, 4);
+		assert(stale != "inne");
+#endif
+	}
+
+	// The inner scope's space gets reused, and the outer result is intact.
+	const std::string_view d = cppbits::format_temp("again {0}", 4);
+	assert(d.data() == inner_address);
+	assert(d == "again 4" && is_terminated(d));
+	assert(a == "outer 1" && is_terminated(a));
+}
+
+void chunk_boundary_tests()
+{
+	cppbits::temp_scope scope;
+
+	// Fill most of the first chunk, then render strings that can't fit in
+	// what's left, so they have to move to a new chunk mid-render.
+	std::vector<std::string_view> results;
+	std::vector<std::string> expected;
+	const std::string filler(1000, 'f');
+	for (int i = 0; i < 40; ++i)
+	{
+		results.push_back(cppbits::format_temp("{0}:{1}", i, filler));
+		expected.push_back(std::to_string(i) + ":" + filler);
+	}
+
+	// One much bigger than a whole chunk.
+	const std::string big(50 * 1024, 'b');
+	results.push_back(cppbits::format_temp("[{0}]", big));
+	expected.push_back("[" + big + "]");
+
+	// And small ones after it.
+	results.push_back(cppbits::format_temp("after {0}", 1));
+	expected.push_back("after 1");
+
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		assert(results[i] == expected[i]);
+		assert(is_terminated(results[i]));
+	}
+}
+
+void reuse_tests()
+{
+	// The chunks from earlier scopes are kept; a second pass over the same
+	// work uses the same memory.
+	const char* first;
+	{
+		cppbits::temp_scope scope;
+		first = cppbits::format_temp("{0}", std::string(30 * 1024, 'x')).data();
+	}
+	{
+		cppbits::temp_scope scope;
+		const std::string_view s = cppbits::format_temp("{0}", std::string(30 * 1024, 'y'));
+		assert(s.data() == first);
+		assert(s == std::string(30 * 1024, 'y'));
+	}
+}
+
+} // namespace
+
+int main()
+{
+	basic_tests();
+	nested_scope_tests();
+	chunk_boundary_tests();
+	reuse_tests();
+	nested_scope_tests();
+	return 0;
+}
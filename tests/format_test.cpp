@@ -0,0 +1,30 @@
+#include <cassert>
+#include <sstream>
+#include <string>
+
+#include "format.h"
+
+void format_hash_tests();
+void string_builder_tests();
+
+static void format_tests()
+{
+	std::ostringstream o;
+	o << cppbits::format("{0} + {1} = {2}", 1, 2, 3);
+	assert(o.str() == "1 + 2 = 3");
+
+	// No arguments at all.
+	assert(std::string(cppbits::format("plain text")) == "plain text");
+
+	// Width and precision.
+	assert(std::string(cppbits::format("[{0,5}]", 42)) == "[   42]");
+	assert(std::string(cppbits::format("{0:f2}", 3.14159)) == "3.14");
+}
+
+int main()
+{
+	format_tests();
+	format_hash_tests();
+	string_builder_tests();
+	return 0;
+}
@@ -0,0 +1,182 @@
+// Records format calls from several threads, then saves, loads, and replays
+// them, checking that replay produces exactly what was originally formatted.
+
+#define CPPBITS_FORMAT_TRACE
+#define CPPBITS_FORMAT_TRACE_COUNT_ALLOCATIONS
+
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "enum_flags.h"
+#include "format_trace.h"
+
+enum permissions : uint64_t
+{
+	kPermissionNone = 0,
+	kPermissionRead = 1 << 0,
+	kPermissionWrite = 1 << 1,
+	kPermissionHigh = uint64_t(1) << 63
+};
+
+namespace cppbits {
+template<>
+struct is_enum_flags<permissions> : std::true_type{};
+}
+
+namespace {
+
+enum offset : int8_t { kOffsetBack = -3 };
+enum letter : char { kLetterA = 'A' };
+
+struct point
+{
+	int x, y;
+	friend std::ostream& operator<<(std::ostream& o, const point& p)
+	{
+		return o << '(' << p.x << ", " << p.y << ')';
+	}
+};
+
+// What each recorded thread formatted, in order.
+std::vector<std::vector<std::string>> expected;
+
+template<class ... T>
+std::string render(const cppbits::detail::formatter<T...>& f)
+{
+	std::ostringstream o;
+	o << f;
+	return o.str();
+}
+
+void record_thread(size_t index)
+{
+	std::vector<std::string>& out = expected[index];
+	for (int i = 0; i < 50; ++i)
+	{
+		out.push_back(render(CPPBITS_TRACE_FORMAT("{0} served {1} in {2:f2}ms", "peer\t1", "/index\n", i * 0.25)));
+		out.push_back(render(CPPBITS_TRACE_FORMAT("{0:X} {1} {2} {3}", 255u + i, -i, 'c', point{i, -i})));
+		out.push_back(render(CPPBITS_TRACE_FORMAT("no arguments")));
+		// Enums stream as numbers, and have to replay that way, specifiers and all.
+		out.push_back(render(CPPBITS_TRACE_FORMAT("{0:X} {1:x} {2} {3} {4,4}",
+			static_cast<permissions>(0xff + i), kPermissionRead | kPermissionHigh,
+			kOffsetBack, kLetterA, static_cast<offset>(-i % 100))));
+		out.push_back(render(CPPBITS_TRACE_FORMAT("{0}{1}{2}{3}{4}{5}{6}{7}{8}{9}",
+			0, 1, 2, 3, 4, 5, 6, 7, 8, i)));
+	}
+}
+
+// Twenty calls all recorded at the same instant, replayed at the recorded
+// pace by a handler that takes a millisecond each: every call after the
+// first waits for the ones before it, and the response time has to show it.
+void paced_replay_test()
+{
+	cppbits::format_trace trace;
+	trace.formats.push_back("{0}");
+	trace.thread_count = 1;
+	for (int i = 0; i < 20; ++i)
+	{
+		cppbits::trace_call call;
+		call.timestamp_ns = 0;
+		call.thread = 0;
+		call.format_id = 0;
+		trace.calls.push_back(call);
+	}
+
+	cppbits::replay_options options;
+	options.speed = 1.0;
+	const cppbits::replay_report report = cppbits::replay(trace, options,
+		[](const cppbits::trace_call&) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		});
+
+	assert(report.paced);
+	assert(report.service.max_ns >= 1000000);
+	assert(report.service.p50_ns < 10000000);
+	assert(report.response.max_ns >= 19000000);
+	assert(report.response.p50_ns > report.service.p50_ns);
+
+	std::ostringstream summary;
+	cppbits::print_report(summary, report);
+	assert(summary.str().find("response ns:") != std::string::npos);
+}
+
+} // namespace
+
+int main()
+{
+	const size_t thread_count = 4;
+	expected.resize(thread_count);
+
+	std::vector<std::thread> threads;
+	for (size_t t = 0; t < thread_count; ++t)
+		threads.push_back(std::thread(record_thread, t));
+	for (std::thread& thread : threads)
+		thread.join();
+
+	std::stringstream file;
+	cppbits::trace_recorder::instance().save(file);
+
+	const cppbits::format_trace loaded = cppbits::load_trace(file);
+	assert(loaded.calls.size() == thread_count * 250);
+	assert(loaded.thread_count == thread_count);
+	assert(loaded.formats.size() == 5);
+
+	// A copy has to render just as well as the original.
+	const cppbits::format_trace trace = loaded;
+
+	// Recorded thread indices are assigned in first-record order, which needn't
+	// match the order the threads were started in; match them up by content.
+	std::mutex lock;
+	std::map<uint32_t, std::vector<std::string>> replayed;
+	cppbits::replay_options options;
+	options.iterations = 1;
+	const cppbits::replay_report report = cppbits::replay(trace, options,
+		[&](const cppbits::trace_call& call) {
+			std::ostringstream o;
+			cppbits::render_call(trace, call, o);
+			std::lock_guard<std::mutex> guard(lock);
+			replayed[call.thread].push_back(o.str());
+		});
+
+	assert(report.calls == thread_count * 250);
+	assert(report.allocations_counted);
+	assert(report.allocations > 0);
+	assert(replayed.size() == thread_count);
+	for (const auto& entry : replayed)
+	{
+		bool found = false;
+		for (const std::vector<std::string>& original : expected)
+			found = found || original == entry.second;
+		assert(found);
+	}
+
+	std::ostringstream summary;
+	cppbits::print_report(summary, report);
+	assert(summary.str().find("calls:       1000\n") == 0);
+
+	paced_replay_test();
+
+	// Too many arguments is an error, not a silent truncation.
+	cppbits::trace_call call = trace.calls.front();
+	call.args.resize(cppbits::kMaxTraceArgs + 1);
+	bool threw = false;
+	try
+	{
+		std::ostringstream o;
+		cppbits::render_call(trace, call, o);
+	}
+	catch (const std::length_error&)
+	{
+		threw = true;
+	}
+	assert(threw);
+
+	return 0;
+}
@@ -0,0 +1,109 @@
+#include <cassert>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "interner.h"
+
+namespace {
+
+void dedup_tests(cppbits::interner& names)
+{
+	const std::string_view a = names.intern("requests.api.200");
+	const std::string_view b = names.intern(std::string("requests.api.") + "200");
+	assert(a == "requests.api.200");
+	assert(a.data() == b.data());
+	assert(a.data()[a.size()] == '\0');
+
+	const std::string_view c = names.intern_format("requests.{0}.{1}", "api", 200);
+	assert(c.data() == a.data());
+	assert(names.intern("requests.api.404").data() != a.data());
+
+	const cppbits::interner::id_type id = names.intern_format_id("route:{0}", "/index");
+	assert(names.str(id) == "route:/index");
+	assert(names.intern_id("route:/index") == id);
+	assert(names.str(names.intern_id("requests.api.200")).data() == a.data());
+}
+
+void big_string_tests(cppbits::interner& names)
+{
+	// Bigger than a quarter chunk, so these get their own allocations.
+	const std::string big1(20 * 1024, 'a');
+	const std::string big2(40 * 1024, 'b');
+	const std::string_view small1 = names.intern("small before");
+	const std::string_view b1 = names.intern(big1);
+	const std::string_view small2 = names.intern("small after");
+	const std::string_view b2 = names.intern(big2);
+
+	assert(b1 == big1 && b2 == big2);
+	assert(b1.data()[b1.size()] == '\0');
+	assert(names.intern(big1).data() == b1.data());
+	assert(names.intern(big2).data() == b2.data());
+	assert(names.intern("small before").data() == small1.data());
+	assert(names.intern("small after").data() == small2.data());
+}
+
+void single_shard_tests()
+{
+	// One shard means no bits of the ID go to the shard index.
+	for (size_t shards = 0; shards <= 1; ++shards)
+	{
+		cppbits::interner names(shards);
+		for (int i = 0; i < 1000; ++i)
+		{
+			const cppbits::interner::id_type id = names.intern_format_id("key{0}", i);
+			assert(id == static_cast<cppbits::interner::id_type>(i));
+		}
+		assert(names.size() == 1000);
+		assert(names.str(999) == "key999");
+		dedup_tests(names);
+	}
+}
+
+void concurrent_tests()
+{
+	cppbits::interner names;
+	const int thread_count = 8;
+	const int key_count = 2000;
+
+	std::vector<std::vector<std::string_view>> seen(thread_count);
+	std::vector<std::thread> threads;
+	for (int t = 0; t < thread_count; ++t)
+	{
+		threads.emplace_back([&names, &seen, t] {
+			// Every thread interns the same keys, in a different order.
+			for (int i = 0; i < key_count; ++i)
+			{
+				const int key = (i * 7 + t * 131) % key_count;
+				seen[t].push_back(names.intern_format("metric.{0}.{1}", key % 13, key));
+			}
+		});
+	}
+	for (std::thread& thread : threads)
+		thread.join();
+
+	assert(names.size() == static_cast<size_t>(key_count));
+	for (int t = 0; t < thread_count; ++t)
+	{
+		for (int i = 0; i < key_count; ++i)
+		{
+			const int key = (i * 7 + t * 131) % key_count;
+			const std::string_view expected = names.intern_format("metric.{0}.{1}", key % 13, key);
+			assert(seen[t][i].data() == expected.data());
+		}
+	}
+}
+
+} // namespace
+
+int main()
+{
+	cppbits::interner names;
+	dedup_tests(names);
+	big_string_tests(names);
+	single_shard_tests();
+	concurrent_tests();
+	return 0;
+}
@@ -0,0 +1,172 @@
+#include <cassert>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include "relocate.h"
+
+namespace {
+
+// Counts live instances, and throws from the copy or move constructor once
+// the countdown for it reaches zero.
+struct fragile
+{
+	static int live;
+	static int copies_left;
+	static int moves_left;
+
+	explicit fragile(int v) : value(v) { ++live; }
+
+	fragile(const fragile& other) : value(other.value)
+	{
+		if (copies_left-- == 0)
+			throw std::runtime_error("copy");
+		++live;
+	}
+
+	// Moving leaves the source at kMovedFrom, so tests can see what moved.
+	fragile(fragile&& other) : value(other.value)
+	{
+		if (moves_left-- == 0)
+			throw std::runtime_error("move");
+		other.value = kMovedFrom;
+		++live;
+	}
+
+	fragile& operator=(fragile&& other)
+	{
+		value = other.value;
+		other.value = kMovedFrom;
+		return *this;
+	}
+
+	~fragile() { --live; }
+
+	static const int kMovedFrom = -1;
+
+	int value;
+};
+
+int fragile::live = 0;
+int fragile::copies_left = -1;
+int fragile::moves_left = -1;
+
+// Move-only, with a move constructor that may throw; relocation has to move it.
+struct fragile_move_only : fragile
+{
+	explicit fragile_move_only(int v) : fragile(v) {}
+	fragile_move_only(fragile_move_only&& other) : fragile(std::move(other)) {}
+	fragile_move_only& operator=(fragile_move_only&& other)
+	{
+		fragile::operator=(std::move(other));
+		return *this;
+	}
+};
+
+static_assert(cppbits::is_trivially_relocatable<std::unique_ptr<int>>::value, "");
+static_assert(!cppbits::is_trivially_relocatable<fragile>::value, "");
+
+void unique_ptr_tests()
+{
+	cppbits::relocating_vector<std::unique_ptr<int>> v;
+	for (int i = 0; i < 100; ++i)
+		v.push_back(std::unique_ptr<int>(new int(i)));
+	assert(v.size() == 100);
+
+	v.erase(v.begin() + 10, v.begin() + 20);
+	assert(v.size() == 90);
+	assert(*v[9] == 9 && *v[10] == 20 && *v.back() == 99);
+
+	cppbits::relocating_vector<std::unique_ptr<int>> moved(std::move(v));
+	assert(v.empty() && moved.size() == 90);
+}
+
+void copy_throws_tests()
+{
+	cppbits::relocating_vector<fragile> v;
+	for (int i = 0; i < 10; ++i)
+		v.emplace_back(i);
+	assert(fragile::live == 10);
+
+	// The copy constructor must not leak what it already copied.
+	fragile::copies_left = 5;
+	bool threw = false;
+	try
+	{
+		cppbits::relocating_vector<fragile> copy(v);
+	}
+	catch (const std::runtime_error&)
+	{
+		threw = true;
+	}
+	fragile::copies_left = -1;
+	assert(threw);
+	assert(fragile::live == 10);
+
+	// Growing copies (the move constructor isn't noexcept), so a throw leaves v intact.
+	fragile::copies_left = 3;
+	threw = false;
+	try
+	{
+		v.reserve(100);
+	}
+	catch (const std::runtime_error&)
+	{
+		threw = true;
+	}
+	fragile::copies_left = -1;
+	assert(threw);
+	assert(v.size() == 10 && fragile::live == 10);
+	for (int i = 0; i < 10; ++i)
+		assert(v[i].value == i);
+
+	v.erase(v.begin() + 2);
+	assert(v.size() == 9 && fragile::live == 9);
+	assert(v[1].value == 1 && v[2].value == 3 && v.back().value == 9);
+}
+
+void move_throws_tests()
+{
+	{
+		cppbits::relocating_vector<fragile_move_only> v;
+		v.reserve(4);
+		for (int i = 0; i < 4; ++i)
+			v.emplace_back(i);
+
+		// Full, so this has to relocate; the third move throws.
+		fragile::moves_left = 2;
+		bool threw = false;
+		try
+		{
+			v.emplace_back(4);
+		}
+		catch (const std::runtime_error&)
+		{
+			threw = true;
+		}
+		fragile::moves_left = -1;
+		assert(threw);
+
+		// Every element is still alive, but with a throwing move there's no
+		// way back for the two that were already moved: the basic guarantee,
+		// same as std::vector.
+		assert(v.size() == 4 && fragile::live == 4);
+		assert(v[0].value == fragile::kMovedFrom && v[1].value == fragile::kMovedFrom);
+		assert(v[2].value == 2 && v[3].value == 3);
+
+		v.emplace_back(4);
+		assert(v.size() == 5 && fragile::live == 5);
+	}
+	assert(fragile::live == 0);
+}
+
+} // namespace
+
+int main()
+{
+	unique_ptr_tests();
+	copy_throws_tests();
+	assert(fragile::live == 0);
+	move_throws_tests();
+	return 0;
+}
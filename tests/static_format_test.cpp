@@ -0,0 +1,61 @@
+#include <cassert>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+#include "format.h"
+#include "static_format.h"
+
+namespace {
+
+enum letter : char { kLetterA = 'A' };
+enum small : int8_t { kSmallC = 'C' };
+enum flags : uint64_t { kFlagsHigh = uint64_t(1) << 63 };
+enum plain { kPlainSeven = 7 };
+
+// Everything here is checked at compile time.
+static_assert(std::string_view(cppbits::static_format<"v{0}.{1}.{2}", 2, 4, 1>()) == "v2.4.1");
+static_assert(std::string_view(cppbits::static_format<"[{0,5}]", -42>()) == "[  -42]");
+static_assert(std::string_view(cppbits::static_format<"[{0,2}]", -42>()) == "[-42]");
+static_assert(std::string_view(cppbits::static_format<"{0:x} {0:X} {0:o}", -1>()) == "ffffffff FFFFFFFF 37777777777");
+static_assert(std::string_view(cppbits::static_format<"{0:x} {1:X}", short(-2), static_cast<unsigned short>(0xbeef)>()) == "fffe BEEF");
+static_assert(std::string_view(cppbits::static_format<"{0:x} {0}", int8_t(-1)>()) == "\xff \xff");
+static_assert(std::string_view(cppbits::static_format<"{0} {1:x} {2} {3}", kLetterA, kLetterA, kSmallC, kPlainSeven>()) == "A A C 7");
+static_assert(std::string_view(cppbits::static_format<"{0:X}", kFlagsHigh>()) == "8000000000000000");
+static_assert(std::string_view(cppbits::static_format<"/api/{0}/{1,8}", cppbits::fixed_string("users"), cppbits::fixed_string("id")>()) == "/api/users/      id");
+static_assert(std::string_view(cppbits::static_format<"{0} {1}", true, '!'>()) == "1 !");
+static_assert(std::string_view(cppbits::static_format<"{3}missing{0}", 1>()) == "missing1");
+static_assert(cppbits::static_format<"{0}", 12345>().size() == 5);
+
+template<class ... T>
+std::string runtime_format(const std::string& fmt, T... args)
+{
+	std::ostringstream o;
+	o << cppbits::format(fmt, args...);
+	return o.str();
+}
+
+// The compile-time results have to match what cppbits::format prints.
+#define CHECK_SAME(fmt, ...) \
+	assert(std::string_view(cppbits::static_format<fmt, __VA_ARGS__>()) == runtime_format(fmt, __VA_ARGS__))
+
+} // namespace
+
+int main()
+{
+	CHECK_SAME("[{0,5}] [{1,3}] [{2,1}]", -42, -7, -1000);
+	CHECK_SAME("{0:x} {0:X} {0:o}", -1);
+	CHECK_SAME("{0:x} {0:o} {1:X}", short(-2), static_cast<unsigned short>(0xbeef));
+	CHECK_SAME("{0:x} {0,4:X}", int64_t(-3));
+	CHECK_SAME("{0} {0:x} {0,3}", kLetterA);
+	CHECK_SAME("{0} {0:x}", kSmallC);
+	CHECK_SAME("{0:X} {1}", kFlagsHigh, kPlainSeven);
+	CHECK_SAME("{0} {1} {2,4}", true, 'c', 'd');
+	CHECK_SAME("{0,6}x{1}", 123u, uint8_t('z'));
+
+	// fixed_string arguments print like the std::string they convert to.
+	assert(std::string_view(cppbits::static_format<"/api/{0}/{1,8}", cppbits::fixed_string("users"), cppbits::fixed_string("id")>())
+		== runtime_format("/api/{0}/{1,8}", std::string("users"), std::string("id")));
+	return 0;
+}
@@ -0,0 +1,56 @@
+#include <cassert>
+#include <string>
+#include <vector>
+
+#include "format.h"
+#include "string_builder.h"
+
+void string_builder_tests()
+{
+	// A tiny chunk size so everything spans several chunks.
+	cppbits::string_builder out(4);
+	out.append("HTTP/1.1 200 OK\r\n");
+	out.format_append("{0}: {1}\r\n", "Content-Length", 1234);
+	out.append('x');
+
+	const std::string expected = "HTTP/1.1 200 OK\r\nContent-Length: 1234\r\nx";
+	assert(out.str() == expected);
+	assert(out.size() == expected.size());
+
+#if !defined(_WIN32)
+	// All of it at once.
+	std::vector<iovec> iov;
+	out.to_iovec(iov);
+	std::string joined;
+	for (const iovec& v : iov)
+		joined.append(static_cast<const char*>(v.iov_base), v.iov_len);
+	assert(joined == expected);
+
+	// Drain it the way a writev() loop would, with a small iovec limit and
+	// writes that stop partway into a chunk.
+	std::string sent;
+	while (sent.size() < out.size())
+	{
+		const size_t covered = out.to_iovec(iov, sent.size(), 3);
+		assert(iov.size() <= 3);
+		assert(covered > 0 && sent.size() + covered <= out.size());
+
+		size_t budget = 5;
+		for (const iovec& v : iov)
+		{
+			const size_t n = v.iov_len < budget ? v.iov_len : budget;
+			sent.append(static_cast<const char*>(v.iov_base), n);
+			budget -= n;
+		}
+	}
+	assert(sent == expected);
+
+	assert(out.to_iovec(iov, out.size(), 3) == 0);
+	assert(iov.empty());
+#endif
+
+	out.clear();
+	assert(out.empty());
+	out.format_append("{0}", "again");
+	assert(out.str() == "again");
+}